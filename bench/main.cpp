@@ -0,0 +1,399 @@
+// Benchmarks of the public storage operations.
+//
+// Usage: hkeystore_bench [--output <file>] [--scale <factor>]
+//
+// Prints throughput and latency percentiles of every benchmark as JSON, to stdout or to the output file.
+// Operation counts are multiplied by the scale factor. Volume files are created in the current directory
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "storage.h"
+#include "node.h"
+#include "property_handle.h"
+#include "metrics.h"
+
+using namespace hks;
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+const char* VOLUME_PATH = "bench_volume";
+const size_t PARENTS_COUNT = 100;
+
+struct BenchmarkResult
+{
+   std::string name;
+   size_t threads_count = 1;
+   uint64_t operations = 0;
+   std::chrono::nanoseconds duration = std::chrono::nanoseconds(0);
+   // Sorted latencies of all operations, empty if operations weren't timed separately
+   std::vector<std::chrono::nanoseconds> latencies;
+   // Used instead of latencies when set
+   HistogramSnapshot histogram;
+   bool has_histogram = false;
+};
+
+std::vector<BenchmarkResult> results;
+double scale = 1.0;
+
+size_t scaled(size_t count)
+{
+   return std::max<size_t>(1, static_cast<size_t>(count * scale));
+}
+
+std::chrono::nanoseconds percentile(const std::vector<std::chrono::nanoseconds>& sorted, double p)
+{
+   if (sorted.empty()) {
+      return std::chrono::nanoseconds(0);
+   }
+   size_t i = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+   return sorted[i];
+}
+
+// Runs operation(thread_index, i) operations_count times in each of threads_count threads,
+// timing every call
+void run_benchmark(const std::string& name, size_t threads_count, size_t operations_count, std::function<void(size_t, size_t)> operation)
+{
+   std::vector<std::vector<std::chrono::nanoseconds>> thread_latencies(threads_count);
+   std::vector<std::thread> threads;
+
+   clock_type::time_point start = clock_type::now();
+   for (size_t i_thread = 0; i_thread < threads_count; i_thread++) {
+      threads.emplace_back([&, i_thread]() {
+         std::vector<std::chrono::nanoseconds>& latencies = thread_latencies[i_thread];
+         latencies.reserve(operations_count);
+         for (size_t i = 0; i < operations_count; i++) {
+            clock_type::time_point operation_start = clock_type::now();
+            operation(i_thread, i);
+            latencies.push_back(clock_type::now() - operation_start);
+         }
+      });
+   }
+   for (auto& thread : threads) {
+      thread.join();
+   }
+
+   BenchmarkResult result;
+   result.name = name;
+   result.threads_count = threads_count;
+   result.operations = threads_count * operations_count;
+   result.duration = clock_type::now() - start;
+   for (auto& latencies : thread_latencies) {
+      result.latencies.insert(result.latencies.end(), latencies.begin(), latencies.end());
+   }
+   std::sort(result.latencies.begin(), result.latencies.end());
+   results.push_back(std::move(result));
+
+   std::cerr << name << ": " << results.back().operations << " operations" << std::endl;
+}
+
+std::string get_parent_path(size_t i)
+{
+   return "p" + std::to_string(i % PARENTS_COUNT);
+}
+
+std::string get_node_name(size_t i)
+{
+   return "n" + std::to_string(i / PARENTS_COUNT);
+}
+
+std::string get_node_path(size_t i)
+{
+   return get_parent_path(i) + "." + get_node_name(i);
+}
+
+class BenchmarkStorage
+{
+public:
+   explicit BenchmarkStorage(const VolumeOptions& options = VolumeOptions())
+   {
+      std::remove(VOLUME_PATH);
+      storage = std::make_unique<Storage>();
+      volume = storage->open_volume(VOLUME_PATH, true, options);
+      storage->mount(volume, "");
+      for (size_t i = 0; i < PARENTS_COUNT; i++) {
+         storage->add_node("", get_parent_path(i));
+      }
+   }
+
+   ~BenchmarkStorage()
+   {
+      storage->unmount(volume, "");
+      volume.reset();
+      storage.reset();
+      std::remove(VOLUME_PATH);
+   }
+
+   void add_nodes(size_t count)
+   {
+      for (size_t i = 0; i < count; i++) {
+         storage->add_node(get_parent_path(i), get_node_name(i));
+      }
+   }
+
+   std::unique_ptr<Storage> storage;
+   std::shared_ptr<Volume> volume;
+};
+
+void benchmark_nodes_and_properties()
+{
+   const size_t nodes_count = scaled(20000);
+   BenchmarkStorage bench;
+   Storage* storage = bench.storage.get();
+
+   run_benchmark("add_node", 1, nodes_count, [&](size_t, size_t i) {
+      storage->add_node(get_parent_path(i), get_node_name(i));
+   });
+
+   run_benchmark("get_node", 1, nodes_count, [&](size_t, size_t i) {
+      storage->get_node(get_node_path(i));
+   });
+
+   run_benchmark("set_property_by_path", 1, nodes_count, [&](size_t, size_t i) {
+      storage->set_property(get_node_path(i) + ".value", static_cast<int64_t>(i));
+   });
+
+   run_benchmark("get_property_by_path", 1, nodes_count, [&](size_t, size_t i) {
+      int64_t value;
+      storage->get_property(get_node_path(i) + ".value", value);
+   });
+
+   const size_t handles_count = std::min<size_t>(nodes_count, 1000);
+   std::vector<std::shared_ptr<PropertyHandle>> handles;
+   for (size_t i = 0; i < handles_count; i++) {
+      handles.push_back(storage->prepare(get_node_path(i) + ".value"));
+   }
+
+   run_benchmark("set_property_by_handle", 1, nodes_count, [&](size_t, size_t i) {
+      handles[i % handles_count]->set(static_cast<int64_t>(i));
+   });
+
+   run_benchmark("get_property_by_handle", 1, nodes_count, [&](size_t, size_t i) {
+      int64_t value;
+      handles[i % handles_count]->get(value);
+   });
+}
+
+void benchmark_blobs()
+{
+   const size_t blob_sizes[] = { 100, 4 * 1024, 64 * 1024, 1024 * 1024 };
+   BenchmarkStorage bench;
+   Storage* storage = bench.storage.get();
+
+   for (size_t blob_size : blob_sizes) {
+      const size_t blobs_count = std::max<size_t>(1, scaled(64 * 1024 * 1024 / 16) / blob_size);
+      std::vector<char> blob(blob_size, 'a');
+      std::string name = std::to_string(blob_size);
+
+      run_benchmark("set_blob_" + name, 1, blobs_count, [&](size_t, size_t i) {
+         storage->set_property(get_parent_path(i) + ".blob" + name, blob);
+      });
+
+      run_benchmark("get_blob_" + name, 1, blobs_count, [&](size_t, size_t i) {
+         std::vector<char> value;
+         storage->get_property(get_parent_path(i) + ".blob" + name, value);
+      });
+   }
+}
+
+void benchmark_time_to_live()
+{
+   const size_t nodes_count = scaled(5000);
+   BenchmarkStorage bench;
+   Storage* storage = bench.storage.get();
+   bench.add_nodes(nodes_count);
+
+   std::vector<std::shared_ptr<Node>> nodes;
+   for (size_t i = 0; i < nodes_count; i++) {
+      nodes.push_back(storage->get_node(get_node_path(i)));
+   }
+
+   run_benchmark("set_time_to_live", 1, nodes_count, [&](size_t, size_t i) {
+      nodes[i]->set_time_to_live(std::chrono::hours(1));
+   });
+
+   // Expiry runs in the background, its latencies come from the removal histogram
+   MetricsSnapshot before = get_metrics();
+   clock_type::time_point start = clock_type::now();
+   for (auto& node : nodes) {
+      node->set_time_to_live(std::chrono::milliseconds(1));
+   }
+   nodes.clear();
+
+   uint64_t expected_removals = before.counters["time_to_live_removals"] + nodes_count;
+   clock_type::time_point deadline = start + std::chrono::seconds(10);
+   MetricsSnapshot after = get_metrics();
+   while (after.counters["time_to_live_removals"] < expected_removals && clock_type::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      after = get_metrics();
+   }
+
+   BenchmarkResult result;
+   result.name = "time_to_live_expiry";
+   result.operations = after.counters["time_to_live_removals"] - before.counters["time_to_live_removals"];
+   result.duration = clock_type::now() - start;
+   // Process-wide histogram, only this benchmark removes nodes by time to live
+   result.histogram = after.histograms["time_to_live.removal"];
+   result.has_histogram = true;
+   results.push_back(result);
+
+   std::cerr << result.name << ": " << result.operations << " operations" << std::endl;
+}
+
+void benchmark_subtree_delete()
+{
+   // Each subtree has 1 + 10 + 100 nodes
+   const size_t subtrees_count = scaled(50);
+   const size_t fanout = 10;
+   BenchmarkStorage bench;
+   Storage* storage = bench.storage.get();
+
+   for (size_t i = 0; i < subtrees_count; i++) {
+      std::string subtree_name = "s" + std::to_string(i);
+      storage->add_node("", subtree_name);
+      for (size_t j = 0; j < fanout; j++) {
+         std::string child_name = "c" + std::to_string(j);
+         storage->add_node(subtree_name, child_name);
+         for (size_t k = 0; k < fanout; k++) {
+            storage->add_node(subtree_name + "." + child_name, "c" + std::to_string(k));
+         }
+      }
+   }
+
+   run_benchmark("remove_subtree", 1, subtrees_count, [&](size_t, size_t i) {
+      storage->remove_node("s" + std::to_string(i));
+   });
+}
+
+void benchmark_mixed_workload()
+{
+   // 80% property reads, 15% property writes, 5% node additions and removals
+   const size_t nodes_count = scaled(10000);
+   const size_t operations_count = scaled(50000);
+   BenchmarkStorage bench;
+   Storage* storage = bench.storage.get();
+   bench.add_nodes(nodes_count);
+   for (size_t i = 0; i < nodes_count; i++) {
+      storage->set_property(get_node_path(i) + ".value", static_cast<int64_t>(i));
+   }
+
+   for (size_t threads_count : { 1, 4, 8 }) {
+      run_benchmark("mixed_" + std::to_string(threads_count) + "_threads", threads_count, operations_count, [&](size_t i_thread, size_t i) {
+         thread_local std::mt19937 random(static_cast<unsigned>(i_thread + 1));
+         size_t i_node = random() % nodes_count;
+         unsigned kind = random() % 100;
+         if (kind < 80) {
+            int64_t value;
+            storage->get_property(get_node_path(i_node) + ".value", value);
+         } else if (kind < 95) {
+            storage->set_property(get_node_path(i_node) + ".value", static_cast<int64_t>(i));
+         } else {
+            // Temporary nodes have names unique to the thread, so additions don't collide
+            std::string name = "t" + std::to_string(i_thread) + "_" + std::to_string(i);
+            std::string parent_path = get_parent_path(i_node);
+            storage->add_node(parent_path, name);
+            storage->remove_node(parent_path + "." + name);
+         }
+      });
+   }
+}
+
+void write_json(std::ostream& os)
+{
+   os << "{\n   \"benchmarks\": [\n";
+   for (size_t i = 0; i < results.size(); i++) {
+      const BenchmarkResult& result = results[i];
+      double seconds = std::chrono::duration<double>(result.duration).count();
+      double throughput = seconds > 0 ? result.operations / seconds : 0;
+
+      std::chrono::nanoseconds mean, p50, p90, p99, p999, max;
+      if (result.has_histogram) {
+         mean = result.histogram.count ? result.histogram.total / static_cast<std::chrono::nanoseconds::rep>(result.histogram.count) : std::chrono::nanoseconds(0);
+         p50 = result.histogram.p50;
+         p90 = result.histogram.p90;
+         p99 = result.histogram.p99;
+         p999 = result.histogram.p999;
+         max = result.histogram.max;
+      } else {
+         std::chrono::nanoseconds total(0);
+         for (auto latency : result.latencies) {
+            total += latency;
+         }
+         mean = result.latencies.empty() ? std::chrono::nanoseconds(0) : total / static_cast<std::chrono::nanoseconds::rep>(result.latencies.size());
+         p50 = percentile(result.latencies, 0.5);
+         p90 = percentile(result.latencies, 0.9);
+         p99 = percentile(result.latencies, 0.99);
+         p999 = percentile(result.latencies, 0.999);
+         max = result.latencies.empty() ? std::chrono::nanoseconds(0) : result.latencies.back();
+      }
+
+      os << "      {\n";
+      os << "         \"name\": \"" << result.name << "\",\n";
+      os << "         \"threads\": " << result.threads_count << ",\n";
+      os << "         \"operations\": " << result.operations << ",\n";
+      os << "         \"seconds\": " << seconds << ",\n";
+      os << "         \"operations_per_second\": " << throughput << ",\n";
+      os << "         \"latency_ns\": { "
+         << "\"mean\": " << mean.count() << ", "
+         << "\"p50\": " << p50.count() << ", "
+         << "\"p90\": " << p90.count() << ", "
+         << "\"p99\": " << p99.count() << ", "
+         << "\"p999\": " << p999.count() << ", "
+         << "\"max\": " << max.count() << " }\n";
+      os << "      }" << (i + 1 < results.size() ? "," : "") << "\n";
+   }
+   os << "   ]\n}\n";
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+   std::string output_path;
+   for (int i = 1; i < argc; i++) {
+      if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+         output_path = argv[++i];
+      } else if (std::strcmp(argv[i], "--scale") == 0 && i + 1 < argc) {
+         scale = std::atof(argv[++i]);
+      } else {
+         std::cerr << "Usage: hkeystore_bench [--output <file>] [--scale <factor>]" << std::endl;
+         return 1;
+      }
+   }
+   if (scale <= 0) {
+      std::cerr << "Scale must be positive" << std::endl;
+      return 1;
+   }
+
+   benchmark_nodes_and_properties();
+   benchmark_blobs();
+   benchmark_time_to_live();
+   benchmark_subtree_delete();
+   benchmark_mixed_workload();
+
+   if (output_path.empty()) {
+      write_json(std::cout);
+   } else {
+      std::ofstream os(output_path);
+      write_json(os);
+      if (!os) {
+         std::cerr << "Can't write " << output_path << std::endl;
+         return 1;
+      }
+   }
+   return 0;
+}
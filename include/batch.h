@@ -0,0 +1,72 @@
+#ifndef HKEYSTORE_BATCH_H
+#define HKEYSTORE_BATCH_H
+
+#include <string>
+#include <vector>
+#include <variant>
+#include <optional>
+#include <memory>
+#include <functional>
+
+#include <value.h>
+
+namespace hks {
+
+class NodeImpl;
+
+// Collects node additions and property changes to apply them at once with Storage::apply or Node::apply
+//
+// Node additions are applied first, so properties of added nodes could be set in the same batch and added nodes
+// could be parents of other added nodes. Names, parents and changed nodes are checked before the first change, so
+// a batch which fails on them changes nothing. Changes of each node are applied under a single lock of the node and
+// the node is saved once, so readers never see a partially applied batch on a node
+
+class Batch
+{
+public:
+   void add_node(const std::string& path, const std::string& name);
+
+   void set_property(const std::string& path, int value);
+   void set_property(const std::string& path, int64_t value);
+   void set_property(const std::string& path, unsigned value);
+   void set_property(const std::string& path, uint64_t value);
+   void set_property(const std::string& path, float value);
+   void set_property(const std::string& path, double value);
+   void set_property(const std::string& path, long double value);
+   void set_property(const std::string& path, const std::string& value);
+   void set_property(const std::string& path, const std::vector<char>& value);
+   void set_property(const std::string& path, void* data, size_t size);
+
+   void remove_property(const std::string& path);
+
+   bool empty() const;
+   void clear();
+
+private:
+   friend class Storage;
+   friend class NodeImpl;
+
+   using Value = hks::Value;
+
+   struct NodeAddition
+   {
+      std::string path;
+      std::string name;
+   };
+
+   struct PropertyChange
+   {
+      std::string path;
+      // No value if property is removed
+      std::optional<Value> value;
+   };
+
+   void apply(const std::function<std::shared_ptr<NodeImpl>(const std::string&)>& get_node, bool relative_paths) const;
+
+   std::vector<NodeAddition> node_additions;
+   std::vector<PropertyChange> property_changes;
+};
+
+}
+
+#endif
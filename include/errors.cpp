@@ -7,7 +7,7 @@ Exception::Exception(const std::string& error)
 {
 }
 
-const char* Exception::what() const
+const char* Exception::what() const noexcept
 {
    return error.c_str();
 }
@@ -10,7 +10,7 @@ class Exception : public std::exception
 {
 public:
    explicit Exception(const std::string& error);
-   const char* what() const override;
+   const char* what() const noexcept override;
 private:
    std::string error;
 };
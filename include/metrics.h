@@ -0,0 +1,35 @@
+#ifndef HKEYSTORE_METRICS_H
+#define HKEYSTORE_METRICS_H
+
+#include <cstdint>
+#include <string>
+#include <map>
+#include <chrono>
+
+namespace hks {
+
+struct HistogramSnapshot
+{
+   uint64_t count = 0;
+   std::chrono::nanoseconds total = std::chrono::nanoseconds(0);
+   std::chrono::nanoseconds max = std::chrono::nanoseconds(0);
+   // Percentiles are accurate to 1/8 of their value
+   std::chrono::nanoseconds p50 = std::chrono::nanoseconds(0);
+   std::chrono::nanoseconds p90 = std::chrono::nanoseconds(0);
+   std::chrono::nanoseconds p99 = std::chrono::nanoseconds(0);
+   std::chrono::nanoseconds p999 = std::chrono::nanoseconds(0);
+};
+
+struct MetricsSnapshot
+{
+   std::map<std::string, uint64_t> counters;
+   std::map<std::string, HistogramSnapshot> histograms;
+};
+
+// Counters and latency histograms of all storages and volumes in the process since its start.
+// Metrics are collected by each thread separately, the snapshot sums them up
+MetricsSnapshot get_metrics();
+
+}
+
+#endif
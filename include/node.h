@@ -4,10 +4,13 @@
 #include <string>
 #include <memory>
 #include <vector>
+#include <utility>
 #include <chrono>
 
 namespace hks {
-   
+
+class Batch;
+
 class Node
 {
 public:
@@ -44,8 +47,23 @@ public:
    void set_property(const std::string& name, void* data, size_t size);
 
    bool remove_property(const std::string& name);
+   // Property is removed after the time, it keeps the time when it's set again before it expires. Expired property is
+   // absent, setting it again creates it without the time. Returns false if the property doesn't exist
+   bool set_property_time_to_live(const std::string& name, std::chrono::milliseconds time);
+
+   // Applies batch with paths relative to this node
+   void apply(const Batch& batch);
 
    void set_time_to_live(std::chrono::milliseconds time);
+   // Node is removed when it's not accessed for the time. It's accessed when it's found by a path or touched.
+   // Accesses are kept in memory, so they cost no writes
+   void set_sliding_time_to_live(std::chrono::milliseconds time);
+   // Sets time to live of all children. Children are loaded and saved, but the time to live tree is changed in one pass
+   void set_children_time_to_live(std::chrono::milliseconds time);
+   // Throws NoSuchNode if any of the children doesn't exist, then no time is set
+   void set_children_time_to_live(const std::vector<std::pair<std::string, std::chrono::milliseconds>>& times);
+   // Extends sliding time to live of the node
+   void touch();
 };
 
 }
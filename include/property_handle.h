@@ -0,0 +1,51 @@
+#ifndef HKEYSTORE_PROPERTY_HANDLE_H
+#define HKEYSTORE_PROPERTY_HANDLE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace hks {
+
+// Property path resolved once for repeated access, created by Storage::prepare
+//
+// The handle keeps the node of the property and the location of the property in the node,
+// so get and set don't parse the path and don't look the property up again.
+// The node is resolved again when it's deleted, or it or one of its ancestors is renamed or removed.
+// Handle must not outlive the storage
+
+class PropertyHandle
+{
+public:
+   PropertyHandle() = default;
+   PropertyHandle(const PropertyHandle&) = delete;
+   void operator=(const PropertyHandle&) = delete;
+
+   bool get(int& value) const;
+   bool get(int64_t& value) const;
+   bool get(unsigned& value) const;
+   bool get(uint64_t& value) const;
+   bool get(float& value) const;
+   bool get(double& value) const;
+   bool get(long double& value) const;
+   bool get(std::string& value) const;
+   bool get(std::vector<char>& value) const;
+
+   // Return false if the node of the property doesn't exist
+   bool set(int value);
+   bool set(int64_t value);
+   bool set(unsigned value);
+   bool set(uint64_t value);
+   bool set(float value);
+   bool set(double value);
+   bool set(long double value);
+   bool set(const std::string& value);
+   bool set(const std::vector<char>& value);
+   bool set(void* data, size_t size);
+
+   bool remove();
+};
+
+}
+
+#endif
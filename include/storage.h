@@ -4,27 +4,46 @@
 
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <shared_mutex>
-#include <unordered_map>
+#include <map>
+#include <optional>
+#include <future>
+#include <mutex>
+#include <atomic>
 
 #include <volume.h>
+#include <value.h>
 
 namespace hks {
 
 class Node;
+class PropertyHandle;
+class Batch;
 class VolumeImpl;
 class NodeImpl;
+class PathCache;
+class ThreadPool;
+template<typename T> class RcuPointer;
+
+struct StorageOptions
+{
+   // Threads executing asynchronous calls, they are started by the first asynchronous call
+   size_t async_threads_count = 4;
+};
 
 class Storage
 {
 public:
-   Storage() = default;
+   Storage();
+   explicit Storage(const StorageOptions& options);
+   ~Storage();
 
    Storage(const Storage&) = delete;
    void operator=(const Storage&) = delete;
 
    std::shared_ptr<Volume> open_volume(const std::string& path, bool create_if_not_exist);
+   std::shared_ptr<Volume> open_volume(const std::string& path, bool create_if_not_exist, const VolumeOptions& options);
 
    void mount(std::shared_ptr<Volume> volume, const std::string& path);
    void mount(std::shared_ptr<Volume> volume, const std::string& path, const std::string& node_path);
@@ -59,29 +78,82 @@ public:
 
    bool remove_property(const std::string& path);
 
+   // Multi-property access. Paths are grouped by node, so each node is resolved and locked once
+   // Values of properties, which don't exist, are empty
+   std::vector<std::optional<Value>> get_properties(const std::vector<std::string>& paths) const;
+   // Returns false for properties, which nodes don't exist. Nodes are changed one by one, if a node throws,
+   // nodes before it stay changed
+   std::vector<bool> set_properties(const std::vector<std::pair<std::string, Value>>& properties);
+
+   // Resolves property path for repeated access
+   std::shared_ptr<PropertyHandle> prepare(const std::string& path);
+
+   void apply(const Batch& batch);
+
+   // Asynchronous calls are executed by the storage thread pool, so callers don't wait for the volume files.
+   // Exceptions are passed to the returned futures. Storage destructor waits for started calls
+   std::future<std::shared_ptr<Node>> get_node_async(const std::string& path);
+   std::future<std::shared_ptr<Node>> add_node_async(const std::string& path, const std::string& name);
+   std::future<void> remove_node_async(const std::string& path);
+   std::future<void> rename_node_async(const std::string& path, const std::string& new_name);
+   std::future<std::optional<Value>> get_property_async(const std::string& path);
+   std::future<bool> set_property_async(const std::string& path, const Value& value);
+   std::future<bool> remove_property_async(const std::string& path);
+   std::future<std::vector<std::optional<Value>>> get_properties_async(const std::vector<std::string>& paths);
+   std::future<std::vector<bool>> set_properties_async(const std::vector<std::pair<std::string, Value>>& properties);
+   std::future<void> apply_async(const Batch& batch);
+
 private:
+   friend class VolumeImpl;
+   friend class PropertyHandleImpl;
+
    struct MountPoint
    {
       MountPoint(std::shared_ptr<VolumeImpl>& volume, const std::string& node_path, std::shared_ptr<NodeImpl>& node);
 
       std::shared_ptr<VolumeImpl> volume;
       std::string node_path;
+      // Hash of the node path inside the volume
+      uint64_t node_path_hash;
       std::shared_ptr<NodeImpl> node;
    };
 
    struct MountNode
    {
-      std::unordered_map<std::string, MountNode> nodes;
+      std::map<std::string, MountNode, std::less<>> nodes;
       std::vector<MountPoint> mount_points;
    };
 
+   std::shared_ptr<NodeImpl> find_node(std::string_view path) const;
+   std::shared_ptr<NodeImpl> resolve_node(std::string_view path) const;
+   uint64_t get_paths_generation() const;
+   ThreadPool* get_thread_pool();
+
+   // Called by volumes when nodes are added or renamed. Renamed and removed nodes invalidate their own cached paths
+   void node_names_added();
+   void mount_points_changed(std::unique_ptr<MountNode> new_root);
+   static bool has_stacked_mount_points(const MountNode& node, bool mounted_above);
+   static bool is_mounted(const MountNode& node, const VolumeImpl* volume);
+   static void detach_volumes(const MountNode& node);
+   static void enable_path_filters(const MountNode& node);
+
    template<typename T>
    bool get_property_impl(const std::string& path, T& value) const;
    template<typename T>
    bool set_property_impl(const std::string& path, const T& value);
 
-   mutable std::shared_mutex volumes_lock;
-   MountNode volumes_root;
+   static constexpr size_t PATH_CACHE_CAPACITY = 64 * 1024;
+
+   // Serializes mount and unmount, lookups read the mount tree without locks
+   std::mutex volumes_lock;
+   std::unique_ptr<RcuPointer<MountNode>> volumes_root;
+   // Added nodes can shadow cached paths only if volumes are mounted one over another
+   std::atomic<bool> stacked_mount_points = false;
+   std::unique_ptr<PathCache> path_cache;
+
+   StorageOptions options;
+   std::once_flag thread_pool_created;
+   std::unique_ptr<ThreadPool> thread_pool;
 };
 
 }
@@ -0,0 +1,60 @@
+#ifndef HKEYSTORE_TRACING_H
+#define HKEYSTORE_TRACING_H
+
+#include <cstdint>
+#include <string_view>
+
+namespace hks {
+
+enum class TraceEvent
+{
+   // Path of the node, node id of the found node at the end
+   resolve_path,
+   // Node id, record id and serialized size
+   node_load,
+   node_save,
+   // Record id and written size
+   record_read,
+   record_write,
+   // Requested size, record id of the allocated record at the end
+   record_allocation,
+   // Record id of the old record and the new size, record id of the new record at the end
+   record_relocation,
+   record_deletion,
+   // Node id and its new record id, written to the node records table
+   node_record_update,
+   // Node id of the parent and the number of its expired children removed together
+   time_to_live_removal
+};
+
+struct TraceData
+{
+   TraceEvent event = TraceEvent::resolve_path;
+   uint64_t node_id = 0;
+   uint64_t record_id = 0;
+   uint64_t size = 0;
+   // Record allocation reused a free record instead of growing the file
+   bool reused_record = false;
+   // Valid only during the call
+   std::string_view path;
+};
+
+// Receives begin and end events of the traced operations. Events come from any thread, often
+// while volume locks are held, so a tracer must be thread safe and must not call back into the storage
+class Tracer
+{
+public:
+   virtual ~Tracer() = default;
+
+   virtual void begin(const TraceData& data) = 0;
+   // Receives the same data, completed with the values known only at the end of the operation
+   virtual void end(const TraceData& data) = 0;
+};
+
+// Sets the tracer of all storages in the process, null disables tracing.
+// The tracer must stay alive until the operations which started with it are finished
+void set_tracer(Tracer* tracer);
+
+}
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef HKEYSTORE_VALUE_H
+#define HKEYSTORE_VALUE_H
+
+#include <string>
+#include <vector>
+#include <variant>
+#include <cstdint>
+
+namespace hks {
+
+// Property value of any supported type, blobs are std::vector<char>
+using Value = std::variant<int, unsigned, int64_t, uint64_t, float, double, long double, std::string, std::vector<char>>;
+
+}
+
+#endif
@@ -1,8 +1,39 @@
 #ifndef HKEYSTORE_VOLUME_H
 #define HKEYSTORE_VOLUME_H
 
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+
 namespace hks {
 
+struct VolumeOptions
+{
+   // In write-back mode node changes are kept in memory and written to the volume file by a background thread.
+   // Changes made after the last flush are lost if the process terminates without unmounting the volume
+   bool write_back = false;
+
+   // Write-back mode: changed nodes are written at least this often
+   std::chrono::milliseconds flush_interval = std::chrono::milliseconds(1000);
+
+   // Write-back mode: changed nodes are written earlier, if their total size exceeds this limit
+   size_t max_dirty_bytes = 16 * 1024 * 1024;
+
+   // Recently used nodes are kept loaded while their total serialized size is below this limit, 0 disables the cache
+   size_t node_cache_size = 64 * 1024 * 1024;
+};
+
+struct NodeCacheStatistics
+{
+   // Child nodes found loaded
+   uint64_t hits = 0;
+   // Child nodes read from the volume file
+   uint64_t misses = 0;
+   uint64_t evictions = 0;
+   size_t nodes_count = 0;
+   size_t size = 0;
+};
+
 class Volume
 {
 protected:
@@ -12,8 +43,17 @@ protected:
 
 public:
    virtual ~Volume() = default;
+
+   // Writes all changes kept in memory to the volume file
+   virtual void flush() = 0;
+
+   virtual NodeCacheStatistics get_node_cache_statistics() const = 0;
 };
 
+// Expired nodes of all volumes in the process are removed by a shared pool of threads, 2 by default.
+// A volume is processed by one thread at a time, so more threads help when many volumes have expired nodes
+void set_time_to_live_threads_count(size_t threads_count);
+
 }
 
 #endif
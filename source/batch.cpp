@@ -0,0 +1,174 @@
+#include <map>
+#include <set>
+
+#include <batch.h>
+#include <errors.h>
+
+#include "node_impl.h"
+#include "utility.h"
+
+namespace hks {
+
+void Batch::add_node(const std::string& path, const std::string& name)
+{
+   node_additions.push_back({ path, name });
+}
+
+void Batch::set_property(const std::string& path, int value)
+{
+   property_changes.push_back({ path, Value(value) });
+}
+
+void Batch::set_property(const std::string& path, int64_t value)
+{
+   property_changes.push_back({ path, Value(value) });
+}
+
+void Batch::set_property(const std::string& path, unsigned value)
+{
+   property_changes.push_back({ path, Value(value) });
+}
+
+void Batch::set_property(const std::string& path, uint64_t value)
+{
+   property_changes.push_back({ path, Value(value) });
+}
+
+void Batch::set_property(const std::string& path, float value)
+{
+   property_changes.push_back({ path, Value(value) });
+}
+
+void Batch::set_property(const std::string& path, double value)
+{
+   property_changes.push_back({ path, Value(value) });
+}
+
+void Batch::set_property(const std::string& path, long double value)
+{
+   property_changes.push_back({ path, Value(value) });
+}
+
+void Batch::set_property(const std::string& path, const std::string& value)
+{
+   property_changes.push_back({ path, Value(value) });
+}
+
+void Batch::set_property(const std::string& path, const std::vector<char>& value)
+{
+   property_changes.push_back({ path, Value(value) });
+}
+
+void Batch::set_property(const std::string& path, void* data, size_t size)
+{
+   const char* begin = static_cast<const char*>(data);
+   property_changes.push_back({ path, Value(std::vector<char>(begin, begin + size)) });
+}
+
+void Batch::remove_property(const std::string& path)
+{
+   property_changes.push_back({ path, std::nullopt });
+}
+
+bool Batch::empty() const
+{
+   return node_additions.empty() && property_changes.empty();
+}
+
+void Batch::clear()
+{
+   node_additions.clear();
+   property_changes.clear();
+}
+
+static std::string get_child_path(const std::string& parent_path, const std::string& name)
+{
+   return parent_path.empty() ? name : parent_path + "." + name;
+}
+
+void Batch::apply(const std::function<std::shared_ptr<NodeImpl>(const std::string&)>& get_node, bool relative_paths) const
+{
+   // Paths of the added nodes, they could be parents and changing nodes of the same batch
+   std::set<std::string> added_paths;
+   std::map<std::string, std::vector<std::string>> names_by_parent_paths;
+   for (auto& node_addition : node_additions) {
+      if (node_addition.name.find('.') != std::string::npos) {
+         throw LogicError("Can't add node with name '" + node_addition.name + "'. Node names can't contain dots");
+      }
+      if (!added_paths.insert(get_child_path(node_addition.path, node_addition.name)).second) {
+         throw NodeAlreadyExists("Node " + node_addition.name + " already exists.");
+      }
+      names_by_parent_paths[node_addition.path].push_back(node_addition.name);
+   }
+
+   std::map<std::string, std::vector<NodeImpl::PropertyChange>> changes_by_node_paths;
+   for (auto& property_change : property_changes) {
+      std::string_view node_path;
+      std::string_view property_name;
+      if (relative_paths) {
+         // Property name without a node path refers to a property of the node the batch is applied to
+         split_node_path(property_change.path, node_path, property_name);
+      } else if (!split_property_path(property_change.path, node_path, property_name)) {
+         throw LogicError(property_change.path + " is not a valid property path");
+      }
+      const Value* value = property_change.value ? &*property_change.value : nullptr;
+      changes_by_node_paths[std::string(node_path)].push_back({ std::string(property_name), value });
+   }
+
+   // Everything is checked before the first change, so a failed batch changes nothing. Nodes added by the batch
+   // are resolved after they are added
+   std::map<std::string, std::shared_ptr<NodeImpl>> nodes;
+   for (auto& parent_path_names : names_by_parent_paths) {
+      if (added_paths.count(parent_path_names.first) != 0) {
+         continue;
+      }
+      std::shared_ptr<NodeImpl> parent = get_node(parent_path_names.first);
+      if (!parent) {
+         throw NoSuchNode("Node '" + parent_path_names.first + "' doesn't exist");
+      }
+      for (auto& name : parent_path_names.second) {
+         if (parent->get_child_impl(name)) {
+            throw NodeAlreadyExists("Node " + name + " already exists.");
+         }
+      }
+      nodes[parent_path_names.first] = parent;
+   }
+
+   for (auto& node_path_changes : changes_by_node_paths) {
+      if (added_paths.count(node_path_changes.first) != 0 || nodes.count(node_path_changes.first) != 0) {
+         continue;
+      }
+      std::shared_ptr<NodeImpl> node = get_node(node_path_changes.first);
+      if (!node) {
+         throw NoSuchNode("Node '" + node_path_changes.first + "' doesn't exist");
+      }
+      nodes[node_path_changes.first] = node;
+   }
+
+   // Parents are added before their children, as their paths are ordered first
+   for (auto& parent_path_names : names_by_parent_paths) {
+      std::shared_ptr<NodeImpl>& parent = nodes[parent_path_names.first];
+      if (!parent) {
+         parent = get_node(parent_path_names.first);
+         if (!parent) {
+            // Removed concurrently after it was added
+            throw NoSuchNode("Node '" + parent_path_names.first + "' doesn't exist");
+         }
+      }
+      parent->add_children_impl(parent_path_names.second);
+   }
+
+   for (auto& node_path_changes : changes_by_node_paths) {
+      std::shared_ptr<NodeImpl>& node = nodes[node_path_changes.first];
+      if (!node) {
+         node = get_node(node_path_changes.first);
+         if (!node) {
+            // Removed concurrently after it was added
+            throw NoSuchNode("Node '" + node_path_changes.first + "' doesn't exist");
+         }
+      }
+      node->apply_property_changes(node_path_changes.second);
+   }
+}
+
+}
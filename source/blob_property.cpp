@@ -1,3 +1,5 @@
+#include <sstream>
+
 #include "blob_property.h"
 
 namespace hks {
@@ -13,17 +15,53 @@ std::vector<char> BlobProperty::load(std::shared_ptr<VolumeFile> volume_file)
    std::vector<char> res;
    res.resize(size);
 
+   if (!is_chunked()) {
+      volume_file->read_record(record_id, [&](std::istream& is) {
+         is.read(&res[0], size);
+      });
+      return res;
+   }
+
+   std::vector<record_id_t> chunk_record_ids;
    volume_file->read_record(record_id, [&](std::istream& is) {
-      is.read(&res[0], size);
+      hks::deserialize(is, chunk_record_ids);
    });
 
+   std::vector<size_t> chunk_sizes = get_chunk_sizes(size);
+   size_t offset = 0;
+   for (size_t i_chunk = 0; i_chunk < chunk_sizes.size(); i_chunk++) {
+      volume_file->read_record(chunk_record_ids[i_chunk], [&](std::istream& is) {
+         is.read(&res[offset], chunk_sizes[i_chunk]);
+      });
+      offset += chunk_sizes[i_chunk];
+   }
+
    return res;
 }
 
 void BlobProperty::store(std::shared_ptr<VolumeFile> volume_file, const void* data, size_t size)
 {
+   if (record_id != INVALID_RECORD_ID && (is_chunked() || size > CHUNK_SIZE)) {
+      // Chunks aren't reused, the blob is written again
+      remove(volume_file);
+   }
    this->size = size;
 
+   if (is_chunked()) {
+      std::vector<record_id_t> chunk_record_ids;
+      const char* chunk_data = static_cast<const char*>(data);
+      for (size_t chunk_size : get_chunk_sizes(size)) {
+         chunk_record_ids.push_back(volume_file->allocate_record(chunk_data, chunk_size));
+         chunk_data += chunk_size;
+      }
+
+      std::ostringstream os;
+      hks::serialize(os, chunk_record_ids);
+      std::string index = os.str();
+      record_id = volume_file->allocate_record(index.c_str(), index.length());
+      return;
+   }
+
    if (record_id == INVALID_RECORD_ID) {
       record_id = volume_file->allocate_record(data, size);
    } else {
@@ -33,12 +71,37 @@ void BlobProperty::store(std::shared_ptr<VolumeFile> volume_file, const void* da
 
 void BlobProperty::remove(std::shared_ptr<VolumeFile> volume_file)
 {
+   if (is_chunked()) {
+      std::vector<record_id_t> chunk_record_ids;
+      volume_file->read_record(record_id, [&](std::istream& is) {
+         hks::deserialize(is, chunk_record_ids);
+      });
+      for (record_id_t chunk_record_id : chunk_record_ids) {
+         volume_file->delete_record(chunk_record_id);
+      }
+   }
    volume_file->delete_record(record_id);
 
    size = 0;
    record_id = INVALID_RECORD_ID;
 }
 
+std::vector<size_t> BlobProperty::get_chunk_sizes(size_t size)
+{
+   std::vector<size_t> chunk_sizes(size / CHUNK_SIZE, CHUNK_SIZE);
+   size_t tail_size = size % CHUNK_SIZE;
+   for (size_t chunk_size = CHUNK_SIZE / 2; chunk_size >= VolumeFile::RECORD_SIZES[0]; chunk_size /= 2) {
+      if (tail_size >= chunk_size) {
+         chunk_sizes.push_back(chunk_size);
+         tail_size -= chunk_size;
+      }
+   }
+   if (tail_size > 0) {
+      chunk_sizes.push_back(tail_size);
+   }
+   return chunk_sizes;
+}
+
 BlobHolder::BlobHolder(const void* data, size_t size)
    : data(data)
    , size(size)
@@ -15,6 +15,9 @@ struct BlobHolder {
    BlobHolder(const std::vector<char>& data);
 };
 
+// Blobs larger than CHUNK_SIZE are stored in chunks, which are listed in an extent index record. Chunks are written
+// one at a time and the tail is split into record sizes, so a large blob doesn't take a record of the next size
+
 class BlobProperty {
 public:
    BlobProperty();
@@ -28,8 +31,14 @@ public:
 
 private:
    static const record_id_t INVALID_RECORD_ID = record_id_t(-1);
+   static constexpr size_t CHUNK_SIZE = 1 << 20;
+
+   bool is_chunked() const { return size > CHUNK_SIZE; }
+   // Full chunks, then the tail split into record sizes, only the last chunk is padded
+   static std::vector<size_t> get_chunk_sizes(size_t size);
 
    size_t size;
+   // Extent index record if the blob is chunked
    record_id_t record_id;
 };
 
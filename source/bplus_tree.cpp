@@ -1,7 +1,4 @@
-#define _SCL_SECURE_NO_WARNINGS
-
 #include <cassert>
-#include <list>
 #include <algorithm>
 #include <chrono>
 #include <vector>
@@ -15,759 +12,517 @@
 
 namespace hks {
 
-using std::swap;
-using std::binary_search;
-using std::lower_bound;
-using std::upper_bound;
-
-/* helper iterating function */
-template<class T>
-inline typename T::child_t begin(T &node) {
-   return node.children;
-}
-template<class T>
-inline typename T::child_t end(T &node) {
-   return node.children + node.n;
-}
-
-template<class key_t, class value_t, class record_t>
-struct record_t_compare
-{
-   bool operator () (const record_t& record, const key_t& key)
-   {
-      return record.key < key;
-   }
-
-   bool operator () (const key_t& key, const record_t& record)
-   {
-      return key < record.key;
-   }
-};
-
 template<class key_t, class value_t>
 BplusTree<key_t, value_t>::BplusTree(std::shared_ptr<VolumeFile> volume_file, record_id_t meta_record_id)
-   : volume_file(volume_file)
-   , meta_record_id(meta_record_id)
+   : meta_record_id(meta_record_id)
+   , volume_file(volume_file)
 {
-   map(&meta, meta_record_id);
+   volume_file->read_record(meta_record_id, [&](std::istream& is) {
+      deserialize(is, meta);
+   });
 }
 
 template<class key_t, class value_t>
 BplusTree<key_t, value_t>::BplusTree(std::shared_ptr<VolumeFile> volume_file)
-   : volume_file(volume_file)
+   : meta_record_id(EMPTY_RECORD_ID)
+   , volume_file(volume_file)
 {
-   // init default meta
-   memset(&meta, 0, sizeof(meta_t));
-   meta.order = BP_ORDER;
-   meta.height = 1;
-
-   // init root node
-   internal_node_t root;
-   root.next = root.prev = root.parent = 0;
-   meta.root_offset = alloc(&root);
-
-   // init empty leaf
-   leaf_node_t leaf;
-   leaf.next = leaf.prev = 0;
-   leaf.parent = meta.root_offset;
-   root.children[0].child = alloc(&leaf);
-
-   // save
-   meta_record_id = EMPTY_RECORD_ID;
-   unmap(&leaf, root.children[0].child);
-   unmap(&root, meta.root_offset);
-   unmap(&meta, meta_record_id);
-}
-
-template<class key_t>
-inline int keycmp(const key_t &a, const key_t &b) {
-   if (a < b) {
-      return -1;
-   }
-   if (b < a) {
-      return 1;
-   }
-   return 0;
+   node_t root;
+   meta.root_record_id = store(root, EMPTY_RECORD_ID);
+   save_meta();
 }
 
 template<class key_t, class value_t>
 bool BplusTree<key_t, value_t>::get_first(key_t* key, value_t* value) const
 {
-   leaf_node_t leaf;
-   map(&leaf, search_leaf(key_t()));
-   if (leaf.n == 0) {
+   std::vector<entry_t> entries;
+   collect(meta.root_record_id, nullptr, 1, entries);
+   if (entries.empty()) {
       return false;
    }
 
-   *key = leaf.children[0].key;
-   *value = leaf.children[0].value;
+   *key = entries[0].first;
+   *value = entries[0].second;
    return true;
 }
 
 template<class key_t, class value_t>
 int BplusTree<key_t, value_t>::search(const key_t& key, value_t* value) const
 {
-   leaf_node_t leaf;
-   map(&leaf, search_leaf(key));
-
-   // finding the record
-   record_t* record = find(leaf, key);
-   if (record != leaf.children + leaf.n) {
-      // always return the lower bound
-      *value = record->value;
-
-      return keycmp(record->key, key);
+   node_t node;
+   load(node, meta.root_record_id);
+   while (!node.is_leaf) {
+      load(node, node.children[find_child(node, key)]);
    }
-   else {
+
+   auto it = std::lower_bound(node.keys.begin(), node.keys.end(), key);
+   if (it == node.keys.end() || key < *it) {
       return -1;
    }
+
+   *value = node.values[it - node.keys.begin()];
+   return 0;
 }
 
 template<class key_t, class value_t>
 int BplusTree<key_t, value_t>::remove(const key_t& key)
 {
-   internal_node_t parent;
-   leaf_node_t leaf;
-
-   // find parent node
-   record_id_t parent_off = search_index(key);
-   map(&parent, parent_off);
-
-   // find current node
-   index_t *where = find(parent, key);
-   record_id_t offset = where->child;
-   map(&leaf, offset);
-
-   // verify
-   if (!binary_search(begin(leaf), end(leaf), key, record_t_compare<key_t, value_t, record_t>()))
-      return -1;
-
-   size_t min_n = meta.leaf_node_num == 1 ? 0 : meta.order / 2;
-   assert(leaf.n >= min_n && leaf.n <= meta.order);
-
-   // delete the key
-   record_t *to_delete = find(leaf, key);
-   std::copy(to_delete + 1, end(leaf), to_delete);
-   leaf.n--;
-
-   // merge or borrow
-   if (leaf.n < min_n) {
-      // first borrow from left
-      bool borrowed = false;
-      if (leaf.prev != 0)
-         borrowed = borrow_key(false, leaf);
-
-      // then borrow from right
-      if (!borrowed && leaf.next != 0)
-         borrowed = borrow_key(true, leaf);
-
-      // finally we merge
-      if (!borrowed) {
-         assert(leaf.next != 0 || leaf.prev != 0);
-
-         key_t index_key;
-
-         if (where == end(parent) - 1) {
-            // if leaf is last element then merge | prev | leaf |
-            assert(leaf.prev != 0);
-            leaf_node_t prev;
-            map(&prev, leaf.prev);
-            index_key = begin(prev)->key;
-
-            merge_leafs(&prev, &leaf);
-            node_remove(&prev, &leaf);
-            unmap(&prev, leaf.prev);
-         }
-         else {
-            // else merge | leaf | next |
-            assert(leaf.next != 0);
-            leaf_node_t next;
-            map(&next, leaf.next);
-            index_key = begin(leaf)->key;
-
-            merge_leafs(&leaf, &next);
-            node_remove(&leaf, &next);
-            unmap(&leaf, offset);
-         }
-
-         // remove parent's key
-         remove_from_index(parent_off, parent, index_key);
-      }
-      else {
-         unmap(&leaf, offset);
-      }
-   }
-   else {
-      unmap(&leaf, offset);
-   }
-
-   return 0;
+   return remove(std::vector<key_t>{ key }) == 1 ? 0 : -1;
 }
 
 template<class key_t, class value_t>
 int BplusTree<key_t, value_t>::insert(const key_t& key, const value_t& value)
 {
-   record_id_t parent = search_index(key);
-   record_id_t offset = search_leaf(parent, key);
-   leaf_node_t leaf;
-   map(&leaf, offset);
-
-   // check if we have the same key
-   if (binary_search(begin(leaf), end(leaf), key, record_t_compare<key_t, value_t, record_t>()))
+   bool inserted = false;
+   record_id_t root_record_id = meta.root_record_id;
+   split_t split = insert(root_record_id, key, value, inserted);
+   if (!inserted) {
       return 1;
-
-   if (leaf.n == meta.order) {
-      // split when full
-
-      // new sibling leaf
-      leaf_node_t new_leaf;
-      node_create(offset, &leaf, &new_leaf);
-
-      // find even split point
-      size_t point = leaf.n / 2;
-      bool place_right = keycmp(key, leaf.children[point].key) > 0;
-      if (place_right)
-         ++point;
-
-      // split
-      std::copy(leaf.children + point, leaf.children + leaf.n,
-         new_leaf.children);
-      new_leaf.n = leaf.n - point;
-      leaf.n = point;
-
-      // which part do we put the key
-      if (place_right)
-         insert_record_no_split(&new_leaf, key, value);
-      else
-         insert_record_no_split(&leaf, key, value);
-
-      // save leafs
-      unmap(&leaf, offset);
-      unmap(&new_leaf, leaf.next);
-
-      // insert new index key
-      insert_key_to_index(parent, new_leaf.children[0].key,
-         offset, leaf.next);
    }
-   else {
-      insert_record_no_split(&leaf, key, value);
-      unmap(&leaf, offset);
+
+   if (split.is_split) {
+      node_t root;
+      root.is_leaf = false;
+      root.keys.push_back(split.key);
+      root.children.push_back(root_record_id);
+      root.children.push_back(split.record_id);
+      root_record_id = store(root, EMPTY_RECORD_ID);
    }
 
+   if (root_record_id != meta.root_record_id) {
+      meta.root_record_id = root_record_id;
+      save_meta();
+   }
    return 0;
 }
 
-template<typename key_t, typename value_t>
-record_id_t BplusTree<key_t, value_t>::get_record_id() const
+template<class key_t, class value_t>
+void BplusTree<key_t, value_t>::get_until(const key_t& last_key, size_t max_count, std::vector<entry_t>& entries) const
 {
-   return meta_record_id;
+   if (max_count == 0) {
+      return;
+   }
+   collect(meta.root_record_id, &last_key, entries.size() + max_count, entries);
 }
 
 template<class key_t, class value_t>
-void BplusTree<key_t, value_t>::remove_from_index(record_id_t offset, internal_node_t& node, const key_t& key)
+size_t BplusTree<key_t, value_t>::remove(const std::vector<key_t>& keys)
 {
-   size_t min_n = meta.root_offset == offset ? 1 : meta.order / 2;
-   assert(node.n >= min_n && node.n <= meta.order);
-
-   // remove key
-   key_t index_key = begin(node)->key;
-   index_t *to_delete = find(node, key);
-   if (to_delete != end(node)) {
-      (to_delete + 1)->child = to_delete->child;
-      std::copy(to_delete + 1, end(node), to_delete);
-   }
-   node.n--;
-
-   // remove to only one key
-   if (node.n == 1 && meta.root_offset == offset &&
-      meta.internal_node_num != 1)
-   {
-      unalloc(&node, meta.root_offset);
-      meta.height--;
-      meta.root_offset = node.children[0].child;
-      unmap(&meta, meta_record_id);
-      return;
+   assert(std::is_sorted(keys.begin(), keys.end()));
+   if (keys.empty()) {
+      return 0;
    }
 
-   // merge or borrow
-   if (node.n < min_n) {
-      internal_node_t parent;
-      map(&parent, node.parent);
-
-      // first borrow from left
-      bool borrowed = false;
-      if (offset != begin(parent)->child)
-         borrowed = borrow_key(false, node, offset);
-
-      // then borrow from right
-      if (!borrowed && offset != (end(parent) - 1)->child)
-         borrowed = borrow_key(true, node, offset);
-
-      // finally we merge
-      if (!borrowed) {
-         assert(node.next != 0 || node.prev != 0);
-
-         if (offset == (end(parent) - 1)->child) {
-            // if leaf is last element then merge | prev | leaf |
-            assert(node.prev != 0);
-            internal_node_t prev;
-            map(&prev, node.prev);
-
-            // merge
-            index_t *where = find(parent, begin(prev)->key);
-            reset_index_children_parent(begin(node), end(node), node.prev);
-            merge_keys(where, prev, node);
-            unmap(&prev, node.prev);
-         }
-         else {
-            // else merge | leaf | next |
-            assert(node.next != 0);
-            internal_node_t next;
-            map(&next, node.next);
-
-            // merge
-            index_t *where = find(parent, index_key);
-            reset_index_children_parent(begin(next), end(next), offset);
-            merge_keys(where, node, next);
-            unmap(&node, offset);
-         }
+   node_t root;
+   load(root, meta.root_record_id);
+   size_t removed_count = remove(root, keys.data(), keys.data() + keys.size());
+   if (removed_count == 0) {
+      return 0;
+   }
 
-         // remove parent's key
-         remove_from_index(node.parent, parent, index_key);
-      }
-      else {
-         unmap(&node, offset);
+   record_id_t root_record_id = meta.root_record_id;
+   if (!root.is_leaf && root.children.size() == 1) {
+      // Children of the root were merged into one, it becomes the new root
+      while (!root.is_leaf && root.children.size() == 1) {
+         volume_file->delete_record(root_record_id);
+         root_record_id = root.children[0];
+         load(root, root_record_id);
       }
+   } else {
+      root_record_id = store(root, root_record_id);
    }
-   else {
-      unmap(&node, offset);
+
+   if (root_record_id != meta.root_record_id) {
+      meta.root_record_id = root_record_id;
+      save_meta();
    }
+   return removed_count;
 }
 
 template<class key_t, class value_t>
-bool BplusTree<key_t, value_t>::borrow_key(bool from_right, internal_node_t &borrower, record_id_t offset)
+size_t BplusTree<key_t, value_t>::insert(const std::vector<entry_t>& entries)
 {
-   typedef typename internal_node_t::child_t child_t;
+   assert(std::is_sorted(entries.begin(), entries.end(), [](const entry_t& lhs, const entry_t& rhs) { return lhs.first < rhs.first; }));
+   if (entries.empty()) {
+      return 0;
+   }
 
-   record_id_t lender_off = from_right ? borrower.next : borrower.prev;
-   internal_node_t lender;
-   map(&lender, lender_off);
+   node_t root;
+   load(root, meta.root_record_id);
+   size_t inserted_count = insert(root, entries.data(), entries.data() + entries.size());
+   if (inserted_count == 0) {
+      return 0;
+   }
+
+   record_id_t root_record_id = meta.root_record_id;
+   while (root.size() > ORDER) {
+      // The root is split under a new root until it fits
+      node_t new_root;
+      new_root.is_leaf = false;
+      new_root.children.push_back(root_record_id);
+      store_split(root, new_root, 0);
+      root = std::move(new_root);
+      root_record_id = EMPTY_RECORD_ID;
+   }
+   root_record_id = store(root, root_record_id);
 
-   assert(lender.n >= meta.order / 2);
-   if (lender.n != meta.order / 2) {
-      child_t where_to_lend, where_to_put;
+   if (root_record_id != meta.root_record_id) {
+      meta.root_record_id = root_record_id;
+      save_meta();
+   }
+   return inserted_count;
+}
 
-      internal_node_t parent;
+template<typename key_t, typename value_t>
+record_id_t BplusTree<key_t, value_t>::get_record_id() const
+{
+   return meta_record_id;
+}
 
-      // swap keys, draw on paper to see why
-      if (from_right) {
-         where_to_lend = begin(lender);
-         where_to_put = end(borrower);
+template<class key_t, class value_t>
+typename BplusTree<key_t, value_t>::split_t BplusTree<key_t, value_t>::insert(record_id_t& record_id, const key_t& key, const value_t& value, bool& inserted)
+{
+   node_t node;
+   load(node, record_id);
 
-         map(&parent, borrower.parent);
-         child_t where = lower_bound(begin(parent), end(parent) - 1, (end(borrower) - 1)->key, record_t_compare<key_t, value_t, index_t>());
-         where->key = where_to_lend->key;
-         unmap(&parent, borrower.parent);
+   split_t child_split;
+   if (node.is_leaf) {
+      auto it = std::lower_bound(node.keys.begin(), node.keys.end(), key);
+      if (it != node.keys.end() && !(key < *it)) {
+         return split_t();
       }
-      else {
-         where_to_lend = end(lender) - 1;
-         where_to_put = begin(borrower);
-
-         map(&parent, lender.parent);
-         child_t where = find(parent, begin(lender)->key);
-         where_to_put->key = where->key;
-         where->key = (where_to_lend - 1)->key;
-         unmap(&parent, lender.parent);
+      node.values.insert(node.values.begin() + (it - node.keys.begin()), value);
+      node.keys.insert(it, key);
+      inserted = true;
+   } else {
+      size_t i_child = find_child(node, key);
+      record_id_t child_record_id = node.children[i_child];
+      child_split = insert(node.children[i_child], key, value, inserted);
+      if (!child_split.is_split && node.children[i_child] == child_record_id) {
+         // The node doesn't change
+         return split_t();
+      }
+      if (child_split.is_split) {
+         node.keys.insert(node.keys.begin() + i_child, child_split.key);
+         node.children.insert(node.children.begin() + i_child + 1, child_split.record_id);
       }
-
-      // store
-      std::copy_backward(where_to_put, end(borrower), end(borrower) + 1);
-      *where_to_put = *where_to_lend;
-      borrower.n++;
-
-      // erase
-      reset_index_children_parent(where_to_lend, where_to_lend + 1, offset);
-      std::copy(where_to_lend + 1, end(lender), where_to_lend);
-      lender.n--;
-      unmap(&lender, lender_off);
-      return true;
    }
 
-   return false;
+   split_t result;
+   if (node.size() > ORDER) {
+      node_t right;
+      split(node, result.key, right);
+      result.is_split = true;
+      result.record_id = store(right, EMPTY_RECORD_ID);
+   }
+   record_id = store(node, record_id);
+   return result;
 }
 
 template<class key_t, class value_t>
-bool BplusTree<key_t, value_t>::borrow_key(bool from_right, leaf_node_t &borrower)
-{
-   record_id_t lender_off = from_right ? borrower.next : borrower.prev;
-   leaf_node_t lender;
-   map(&lender, lender_off);
-
-   assert(lender.n >= meta.order / 2);
-   if (lender.n != meta.order / 2) {
-      typename leaf_node_t::child_t where_to_lend, where_to_put;
-
-      // decide offset and update parent's index key
-      if (from_right) {
-         where_to_lend = begin(lender);
-         where_to_put = end(borrower);
-         change_parent_child(borrower.parent, begin(borrower)->key,
-            lender.children[1].key);
+size_t BplusTree<key_t, value_t>::insert(node_t& node, const entry_t* begin, const entry_t* end)
+{
+   if (node.is_leaf) {
+      std::vector<key_t> keys;
+      std::vector<value_t> values;
+      keys.reserve(node.keys.size() + (end - begin));
+      values.reserve(node.keys.size() + (end - begin));
+
+      size_t i_node = 0;
+      for (const entry_t* entry = begin; entry != end; ++entry) {
+         while (i_node < node.keys.size() && node.keys[i_node] < entry->first) {
+            keys.push_back(std::move(node.keys[i_node]));
+            values.push_back(std::move(node.values[i_node]));
+            i_node++;
+         }
+         bool exists = i_node < node.keys.size() && !(entry->first < node.keys[i_node]);
+         bool repeated = !keys.empty() && !(keys.back() < entry->first);
+         if (!exists && !repeated) {
+            keys.push_back(entry->first);
+            values.push_back(entry->second);
+         }
       }
-      else {
-         where_to_lend = end(lender) - 1;
-         where_to_put = begin(borrower);
-         change_parent_child(lender.parent, begin(lender)->key,
-            where_to_lend->key);
+      size_t inserted_count = keys.size() - i_node;
+      for (; i_node < node.keys.size(); i_node++) {
+         keys.push_back(std::move(node.keys[i_node]));
+         values.push_back(std::move(node.values[i_node]));
       }
 
-      // store
-      std::copy_backward(where_to_put, end(borrower), end(borrower) + 1);
-      *where_to_put = *where_to_lend;
-      borrower.n++;
-
-      // erase
-      std::copy(where_to_lend + 1, end(lender), where_to_lend);
-      lender.n--;
-      unmap(&lender, lender_off);
-      return true;
+      node.keys = std::move(keys);
+      node.values = std::move(values);
+      return inserted_count;
    }
 
-   return false;
-}
-
-template<class key_t, class value_t>
-void BplusTree<key_t, value_t>::change_parent_child(record_id_t parent, const key_t& o, const key_t& n)
-{
-   internal_node_t node;
-   map(&node, parent);
+   // Children are visited from the last one, so parts of split children don't move children which aren't visited yet
+   size_t inserted_count = 0;
+   for (size_t i_child = node.children.size(); i_child-- > 0 && begin != end; ) {
+      const entry_t* child_begin = i_child == 0 ? begin :
+         std::lower_bound(begin, end, node.keys[i_child - 1], [](const entry_t& entry, const key_t& key) { return entry.first < key; });
+      if (child_begin == end) {
+         continue;
+      }
 
-   index_t *w = find(node, o);
-   assert(w != node.children + node.n);
+      node_t child;
+      load(child, node.children[i_child]);
+      size_t child_inserted_count = insert(child, child_begin, end);
+      end = child_begin;
+      if (child_inserted_count == 0) {
+         continue;
+      }
 
-   w->key = n;
-   unmap(&node, parent);
-   if (w == node.children + node.n - 1) {
-      change_parent_child(node.parent, o, n);
+      inserted_count += child_inserted_count;
+      store_split(child, node, i_child);
    }
+   return inserted_count;
 }
 
 template<class key_t, class value_t>
-void BplusTree<key_t, value_t>::merge_leafs(leaf_node_t* left, leaf_node_t* right)
-{
-   std::copy(begin(*right), end(*right), end(*left));
-   left->n += right->n;
-}
+void BplusTree<key_t, value_t>::store_split(node_t& node, node_t& parent, size_t i_child)
+{
+   std::vector<key_t> separators;
+   std::vector<record_id_t> record_ids;
+   size_t parts_count = (node.size() + ORDER - 1) / ORDER;
+   for (size_t i_part = parts_count - 1; i_part > 0; i_part--) {
+      // Parts are cut from the end and have equal sizes, so each of them has at least the minimal size
+      node_t right;
+      key_t separator;
+      split(node, node.size() * i_part / (i_part + 1), separator, right);
+      separators.push_back(separator);
+      record_ids.push_back(store(right, EMPTY_RECORD_ID));
+   }
+   parent.children[i_child] = store(node, parent.children[i_child]);
 
-template<class key_t, class value_t>
-void BplusTree<key_t, value_t>::merge_keys(index_t* where, internal_node_t& node, internal_node_t& next)
-{
-   std::copy(begin(next), end(next), end(node));
-   node.n += next.n;
-   node_remove(&node, &next);
+   parent.keys.insert(parent.keys.begin() + i_child, separators.rbegin(), separators.rend());
+   parent.children.insert(parent.children.begin() + i_child + 1, record_ids.rbegin(), record_ids.rend());
 }
 
 template<class key_t, class value_t>
-void BplusTree<key_t, value_t>::insert_record_no_split(leaf_node_t* leaf, const key_t& key, const value_t& value)
+size_t BplusTree<key_t, value_t>::remove(node_t& node, const key_t* begin, const key_t* end)
 {
-   record_t* where = upper_bound(begin(*leaf), end(*leaf), key, record_t_compare<key_t, value_t, record_t>());
-   std::copy_backward(where, end(*leaf), end(*leaf) + 1);
-
-   where->key = key;
-   where->value = value;
-   leaf->n++;
-}
+   size_t removed_count = 0;
 
-template<class key_t, class value_t>
-void BplusTree<key_t, value_t>::insert_key_to_index(record_id_t offset, const key_t& key, record_id_t old, record_id_t after)
-{
-   if (offset == 0) {
-      // create new root node
-      internal_node_t root;
-      root.next = root.prev = root.parent = 0;
-      meta.root_offset = alloc(&root);
-      meta.height++;
-
-      // insert `old` and `after`
-      root.n = 2;
-      root.children[0].key = key;
-      root.children[0].child = old;
-      root.children[1].child = after;
-
-      unmap(&meta, meta_record_id);
-      unmap(&root, meta.root_offset);
-
-      // update children's parent
-      reset_index_children_parent(begin(root), end(root), meta.root_offset);
-      return;
+   if (node.is_leaf) {
+      size_t i_to = 0;
+      for (size_t i_from = 0; i_from < node.keys.size(); i_from++) {
+         begin = std::lower_bound(begin, end, node.keys[i_from]);
+         if (begin != end && !(node.keys[i_from] < *begin)) {
+            removed_count++;
+            continue;
+         }
+         if (i_to != i_from) {
+            node.keys[i_to] = std::move(node.keys[i_from]);
+            node.values[i_to] = std::move(node.values[i_from]);
+         }
+         i_to++;
+      }
+      node.keys.resize(i_to);
+      node.values.resize(i_to);
+      return removed_count;
    }
 
-   internal_node_t node;
-   map(&node, offset);
-   assert(node.n <= meta.order);
-
-   if (node.n == meta.order) {
-      // split when full
-
-      internal_node_t new_node;
-      node_create(offset, &node, &new_node);
-
-      // find even split point
-      size_t point = (node.n - 1) / 2;
-      bool place_right = keycmp(key, node.children[point].key) > 0;
-      if (place_right)
-         ++point;
-
-      // prevent the `key` being the right `middle_key`
-      // example: insert 48 into |42|45| 6|  |
-      if (place_right && keycmp(key, node.children[point].key) < 0)
-         point--;
-
-      key_t middle_key = node.children[point].key;
-
-      // split
-      std::copy(begin(node) + point + 1, end(node), begin(new_node));
-      new_node.n = node.n - point - 1;
-      node.n = point + 1;
-
-      // put the new key
-      if (place_right)
-         insert_key_to_index_no_split(new_node, key, after);
-      else
-         insert_key_to_index_no_split(node, key, after);
-
-      unmap(&node, offset);
-      unmap(&new_node, node.next);
+   // Each child gets the keys before its separator, the changed children are written first and rebalanced after that
+   std::vector<bool> underfull(node.children.size(), false);
+   for (size_t i_child = 0; i_child < node.children.size() && begin != end; i_child++) {
+      const key_t* child_end = i_child < node.keys.size() ? std::lower_bound(begin, end, node.keys[i_child]) : end;
+      if (child_end == begin) {
+         continue;
+      }
 
-      // update children's parent
-      reset_index_children_parent(begin(new_node), end(new_node), node.next);
+      node_t child;
+      load(child, node.children[i_child]);
+      size_t child_removed_count = remove(child, begin, child_end);
+      begin = child_end;
+      if (child_removed_count == 0) {
+         continue;
+      }
 
-      // give the middle key to the parent
-      // note: middle key's child is reserved
-      insert_key_to_index(node.parent, middle_key, offset, node.next);
-   }
-   else {
-      insert_key_to_index_no_split(node, key, after);
-      unmap(&node, offset);
+      removed_count += child_removed_count;
+      node.children[i_child] = store(child, node.children[i_child]);
+      underfull[i_child] = child.size() < MIN_NODE_SIZE;
    }
+
+   rebalance(node, underfull);
+   return removed_count;
 }
 
 template<class key_t, class value_t>
-void BplusTree<key_t, value_t>::insert_key_to_index_no_split(internal_node_t &node, const key_t &key, record_id_t value)
+void BplusTree<key_t, value_t>::rebalance(node_t& node, std::vector<bool>& underfull)
 {
-   index_t *where = upper_bound(begin(node), end(node) - 1, key, record_t_compare<key_t, value_t, index_t>());
-
-   // move later index forward
-   std::copy_backward(where, end(node), end(node) + 1);
-
-   // insert this key
-   where->key = key;
-   where->child = (where + 1)->child;
-   (where + 1)->child = value;
+   size_t i_child = 0;
+   while (i_child < node.children.size() && node.children.size() > 1) {
+      if (!underfull[i_child]) {
+         i_child++;
+         continue;
+      }
 
-   node.n++;
+      size_t i_left = i_child + 1 < node.children.size() ? i_child : i_child - 1;
+      node_t left;
+      node_t right;
+      load(left, node.children[i_left]);
+      load(right, node.children[i_left + 1]);
+      merge(left, node.keys[i_left], right);
+
+      if (left.size() <= ORDER) {
+         volume_file->delete_record(node.children[i_left + 1]);
+         node.children[i_left] = store(left, node.children[i_left]);
+         node.keys.erase(node.keys.begin() + i_left);
+         node.children.erase(node.children.begin() + i_left + 1);
+         underfull.erase(underfull.begin() + i_left + 1);
+         underfull[i_left] = left.size() < MIN_NODE_SIZE;
+         i_child = i_left;
+      } else {
+         // Too many entries for one node, both halves have at least the minimal size
+         split(left, node.keys[i_left], right);
+         node.children[i_left] = store(left, node.children[i_left]);
+         node.children[i_left + 1] = store(right, node.children[i_left + 1]);
+         underfull[i_left] = false;
+         underfull[i_left + 1] = false;
+         i_child = i_left + 1;
+      }
+   }
 }
 
 template<class key_t, class value_t>
-void BplusTree<key_t, value_t>::reset_index_children_parent(index_t* begin, index_t* end, record_id_t parent)
+bool BplusTree<key_t, value_t>::collect(record_id_t record_id, const key_t* last_key, size_t max_count, std::vector<entry_t>& entries) const
 {
-   // this function can change both internal_node_t and leaf_node_t's parent
-   // field, but we should ensure that:
-   // 1. sizeof(internal_node_t) <= sizeof(leaf_node_t)
-   // 2. parent field is placed in the beginning and have same size
-   internal_node_t node;
-   while (begin != end) {
-      map(&node, begin->child);
-      node.parent = parent;
-      unmap(&node, begin->child);
-      ++begin;
+   node_t node;
+   load(node, record_id);
+
+   if (node.is_leaf) {
+      for (size_t i = 0; i < node.keys.size(); i++) {
+         if (entries.size() >= max_count || (last_key && *last_key < node.keys[i])) {
+            return false;
+         }
+         entries.emplace_back(node.keys[i], node.values[i]);
+      }
+      return entries.size() < max_count;
+   }
+
+   for (record_id_t child_record_id : node.children) {
+      if (!collect(child_record_id, last_key, max_count, entries)) {
+         return false;
+      }
    }
+   return true;
 }
 
 template<class key_t, class value_t>
-record_id_t BplusTree<key_t, value_t>::search_index(const key_t &key) const
+void BplusTree<key_t, value_t>::merge(node_t& left, const key_t& separator, node_t& right)
 {
-   record_id_t org = meta.root_offset;
-   size_t height = meta.height;
-   while (height > 1) {
-      internal_node_t node;
-      map(&node, org);
-
-      index_t *i = upper_bound(begin(node), end(node) - 1, key, record_t_compare<key_t, value_t, index_t>());
-      org = i->child;
-      --height;
+   if (left.is_leaf) {
+      left.keys.insert(left.keys.end(), right.keys.begin(), right.keys.end());
+      left.values.insert(left.values.end(), right.values.begin(), right.values.end());
+   } else {
+      left.keys.push_back(separator);
+      left.keys.insert(left.keys.end(), right.keys.begin(), right.keys.end());
+      left.children.insert(left.children.end(), right.children.begin(), right.children.end());
    }
-
-   return org;
 }
 
 template<class key_t, class value_t>
-record_id_t BplusTree<key_t, value_t>::search_leaf(record_id_t index, const key_t &key) const
+void BplusTree<key_t, value_t>::split(node_t& left, key_t& separator, node_t& right)
 {
-   internal_node_t node;
-   map(&node, index);
-
-   index_t* i = upper_bound(begin(node), end(node) - 1, key, record_t_compare<key_t, value_t, index_t>());
-   return i->child;
+   split(left, left.size() / 2, separator, right);
 }
 
 template<class key_t, class value_t>
-template<class T>
-void BplusTree<key_t, value_t>::node_create(record_id_t offset, T* node, T* next)
-{
-   // new sibling node
-   next->parent = node->parent;
-   next->next = node->next;
-   next->prev = offset;
-   node->next = alloc(next);
-   // update next node's prev
-   if (next->next != 0) {
-      T old_next;
-      map(&old_next, next->next);
-      old_next.prev = node->next;
-      unmap(&old_next, next->next);
+void BplusTree<key_t, value_t>::split(node_t& left, size_t position, key_t& separator, node_t& right)
+{
+   right.is_leaf = left.is_leaf;
+   if (left.is_leaf) {
+      right.keys.assign(left.keys.begin() + position, left.keys.end());
+      right.values.assign(left.values.begin() + position, left.values.end());
+      left.keys.resize(position);
+      left.values.resize(position);
+      separator = right.keys[0];
+   } else {
+      separator = left.keys[position - 1];
+      right.keys.assign(left.keys.begin() + position, left.keys.end());
+      right.children.assign(left.children.begin() + position, left.children.end());
+      left.keys.resize(position - 1);
+      left.children.resize(position);
    }
-   unmap(&meta, meta_record_id);
 }
 
 template<class key_t, class value_t>
-template<class T>
-void BplusTree<key_t, value_t>::node_remove(T *prev, T *node)
+size_t BplusTree<key_t, value_t>::find_child(const node_t& node, const key_t& key)
 {
-   unalloc(node, prev->next);
-   prev->next = node->next;
-   if (node->next != 0) {
-      T next;
-      map(&next, node->next);
-      next.prev = node->prev;
-      unmap(&next, node->next);
-   }
-   unmap(&meta, meta_record_id);
+   return std::upper_bound(node.keys.begin(), node.keys.end(), key) - node.keys.begin();
 }
 
 template<class key_t, class value_t>
-template<class T>
-void BplusTree<key_t, value_t>::map(T* block, record_id_t record_id) const
+void BplusTree<key_t, value_t>::load(node_t& node, record_id_t record_id) const
 {
    volume_file->read_record(record_id, [&](std::istream& is) {
-      deserialize(is, *block);
+      deserialize(is, node);
    });
 }
 
 template<class key_t, class value_t>
-template<class T>
-void BplusTree<key_t, value_t>::unmap(T* block, record_id_t& record_id)
+record_id_t BplusTree<key_t, value_t>::store(const node_t& node, record_id_t record_id)
 {
    std::ostringstream os;
-   serialize(os, *block);
+   serialize(os, node);
    std::string data = os.str();
 
    if (record_id == EMPTY_RECORD_ID) {
-      record_id = volume_file->allocate_record(data.c_str(), data.length());
-   } else {
-      record_id = volume_file->resize_record(record_id, data.c_str(), data.length());
+      return volume_file->allocate_record(data.c_str(), data.length());
    }
+   return volume_file->resize_record(record_id, data.c_str(), data.length());
 }
 
 template<class key_t, class value_t>
-typename BplusTree<key_t, value_t>::index_t* BplusTree<key_t, value_t>::find(internal_node_t& node, const key_t& key) {
-   return upper_bound(begin(node), end(node) - 1, key, record_t_compare<key_t, value_t, index_t>());
-}
-
-template<class key_t, class value_t>
-typename BplusTree<key_t, value_t>::record_t* BplusTree<key_t, value_t>::find(leaf_node_t& node, const key_t& key) {
-   return lower_bound(begin(node), end(node), key, record_t_compare<key_t, value_t, record_t>());
-}
-
-template<typename key_t, typename value_t>
-inline void BplusTree<key_t, value_t>::index_t::serialize(std::ostream& os) const
-{
-   hks::serialize(os, key);
-   hks::serialize(os, child);
-}
-
-template<typename key_t, typename value_t>
-inline void BplusTree<key_t, value_t>::index_t::deserialize(std::istream& is)
-{
-   hks::deserialize(is, key);
-   hks::deserialize(is, child);
-}
-
-template<typename key_t, typename value_t>
-inline void BplusTree<key_t, value_t>::record_t::serialize(std::ostream& os) const
-{
-   hks::serialize(os, key);
-   hks::serialize(os, value);
-}
-
-template<typename key_t, typename value_t>
-inline void BplusTree<key_t, value_t>::record_t::deserialize(std::istream& is)
+void BplusTree<key_t, value_t>::save_meta()
 {
-   hks::deserialize(is, key);
-   hks::deserialize(is, value);
-}
+   std::ostringstream os;
+   serialize(os, meta);
+   std::string data = os.str();
 
-template<typename key_t, typename value_t>
-void BplusTree<key_t, value_t>::meta_t::deserialize(std::istream& is)
-{
-   hks::deserialize(is, order);
-   hks::deserialize(is, internal_node_num);
-   hks::deserialize(is, leaf_node_num);
-   hks::deserialize(is, height);
-   hks::deserialize(is, root_offset);
+   // Meta has a fixed size, so its record never moves
+   if (meta_record_id == EMPTY_RECORD_ID) {
+      meta_record_id = volume_file->allocate_record(data.c_str(), data.length());
+   } else {
+      volume_file->write_record(meta_record_id, data.c_str(), data.length());
+   }
 }
 
 template<typename key_t, typename value_t>
 void BplusTree<key_t, value_t>::meta_t::serialize(std::ostream& os) const
 {
-   hks::serialize(os, order);
-   hks::serialize(os, internal_node_num);
-   hks::serialize(os, leaf_node_num);
-   hks::serialize(os, height);
-   hks::serialize(os, root_offset);
-}
-
-template<typename key_t, typename value_t>
-void BplusTree<key_t, value_t>::internal_node_t::deserialize(std::istream& is)
-{
-   hks::deserialize(is, parent);
-   hks::deserialize(is, next);
-   hks::deserialize(is, prev);
-   hks::deserialize(is, n);
-   hks::deserialize(is, children);
+   hks::serialize(os, root_record_id);
 }
 
 template<typename key_t, typename value_t>
-void BplusTree<key_t, value_t>::internal_node_t::serialize(std::ostream& os) const
+void BplusTree<key_t, value_t>::meta_t::deserialize(std::istream& is)
 {
-   hks::serialize(os, parent);
-   hks::serialize(os, next);
-   hks::serialize(os, prev);
-   hks::serialize(os, n);
-   hks::serialize(os, children);
+   hks::deserialize(is, root_record_id);
 }
 
 template<typename key_t, typename value_t>
-void BplusTree<key_t, value_t>::leaf_node_t::deserialize(std::istream& is)
+void BplusTree<key_t, value_t>::node_t::serialize(std::ostream& os) const
 {
-   hks::deserialize(is, parent);
-   hks::deserialize(is, next);
-   hks::deserialize(is, prev);
-   hks::deserialize(is, n);
-   hks::deserialize(is, children);
+   hks::serialize(os, is_leaf);
+   hks::serialize(os, keys);
+   if (is_leaf) {
+      hks::serialize(os, values);
+   } else {
+      hks::serialize(os, children);
+   }
 }
 
 template<typename key_t, typename value_t>
-void BplusTree<key_t, value_t>::leaf_node_t::serialize(std::ostream& os) const
+void BplusTree<key_t, value_t>::node_t::deserialize(std::istream& is)
 {
-   hks::serialize(os, parent);
-   hks::serialize(os, next);
-   hks::serialize(os, prev);
-   hks::serialize(os, n);
-   hks::serialize(os, children);
+   hks::deserialize(is, is_leaf);
+   hks::deserialize(is, keys);
+   if (is_leaf) {
+      hks::deserialize(is, values);
+   } else {
+      hks::deserialize(is, children);
+   }
 }
 
 
-template BplusTree<node_to_remove_key_t, std::vector<node_id_t>>;
+template class BplusTree<node_to_remove_key_t, node_id_t>;
 
 }
@@ -1,10 +1,15 @@
 #ifndef HKEYSTORE_BPLUS_TREE_H
 #define HKEYSTORE_BPLUS_TREE_H
 
-// Code is taken from https://github.com/zcbenz/BPlusTree and adapted to work with VolumeFile instead of separate file
-// Also added support for variable-size values
+// B+ tree stored in volume file records, supports variable-size values.
+//
+// Nodes don't reference their parents and siblings. Changes go down from the root and changed nodes are written
+// on the way back, so a node record moved by VolumeFile::resize_record only changes the reference in its parent.
+// Not thread safe
 
 #include <memory>
+#include <vector>
+#include <utility>
 #include <iostream>
 #include "volume_file.h"
 
@@ -12,168 +17,92 @@ namespace hks {
 
 template<typename key_t, typename value_t>
 class BplusTree {
-   /* internal nodes' index segment */
-   struct index_t {
-      key_t key;
-      record_id_t child;
-
-      void serialize(std::ostream& os) const;
-      void deserialize(std::istream& is);
-   };
+public:
+   using entry_t = std::pair<key_t, value_t>;
 
-   /* the final record of value */
-   struct record_t {
-      key_t key;
-      value_t value;
+   BplusTree(std::shared_ptr<VolumeFile> volume_file, record_id_t meta_record_id);
 
-      void serialize(std::ostream& os) const;
-      void deserialize(std::istream& is);
-   };
+   // Creates empty tree
+   BplusTree(std::shared_ptr<VolumeFile> volume_file);
 
-   static const int BP_ORDER = 100;
+   bool get_first(key_t* key, value_t* value) const;
+   // Returns 0 if the key exists, -1 otherwise
+   int search(const key_t& key, value_t* value) const;
+   // Returns 0 if the key was removed, -1 if it doesn't exist
+   int remove(const key_t& key);
+   // Returns 0 if the key was inserted, 1 if it already exists
+   int insert(const key_t& key, const value_t& value);
 
-   /* meta information of B+ tree */
-   typedef struct {
-      size_t order; /* `order` of B+ tree */
-      size_t internal_node_num; /* how many internal nodes */
-      size_t leaf_node_num;     /* how many leafs */
-      size_t height;            /* height of tree (exclude leafs) */
-      record_id_t root_offset; /* where is the root of internal nodes */
+   // Appends entries with keys up to last_key in the key order, at most max_count of them
+   void get_until(const key_t& last_key, size_t max_count, std::vector<entry_t>& entries) const;
+   // Removes keys in one pass over the tree, keys must be sorted. Returns the number of removed keys
+   size_t remove(const std::vector<key_t>& keys);
+   // Inserts entries in one pass over the tree, entries must be sorted by keys. Existing keys are kept.
+   // Returns the number of inserted entries
+   size_t insert(const std::vector<entry_t>& entries);
 
-      void serialize(std::ostream& os) const;
-      void deserialize(std::istream& is);
-   } meta_t;
+   record_id_t get_record_id() const;
 
-   /***
-   * internal node block
-   ***/
-   struct internal_node_t {
-      using child_t = index_t*;
+private:
+   static const size_t ORDER = 100;
+   static const size_t MIN_NODE_SIZE = ORDER / 2;
+   static const record_id_t EMPTY_RECORD_ID = record_id_t(-1);
 
-      record_id_t parent;
-      record_id_t next;
-      record_id_t prev;
-      size_t n; /* how many children */
-      index_t children[BP_ORDER];
+   struct meta_t {
+      record_id_t root_record_id;
 
       void serialize(std::ostream& os) const;
       void deserialize(std::istream& is);
    };
 
-   /* leaf node block */
-   struct leaf_node_t {
-      using child_t = record_t*;
+   struct node_t {
+      bool is_leaf = true;
+      std::vector<key_t> keys;
+      // Internal nodes: keys[i] is the first key of children[i + 1]
+      std::vector<record_id_t> children;
+      // Leaves: values of the keys
+      std::vector<value_t> values;
 
-      record_id_t parent; /* parent node offset */
-      record_id_t next;
-      record_id_t prev;
-      size_t n;
-      record_t children[BP_ORDER];
+      // Number of children or values
+      size_t size() const { return is_leaf ? keys.size() : children.size(); }
 
       void serialize(std::ostream& os) const;
       void deserialize(std::istream& is);
    };
 
-   static const record_id_t EMPTY_RECORD_ID = record_id_t(-1);
-
-public:
-   BplusTree(std::shared_ptr<VolumeFile> volume_file, record_id_t meta_record_id);
-
-   /* init empty tree */
-   BplusTree(std::shared_ptr<VolumeFile> volume_file);
-
-   /* abstract operations */
-   bool get_first(key_t* key, value_t* value) const;
-   int search(const key_t& key, value_t* value) const;
-   int remove(const key_t& key);
-   int insert(const key_t& key, const value_t& value);
+   // Right half of a split node, which has to be added to the parent
+   struct split_t {
+      bool is_split = false;
+      key_t key;
+      record_id_t record_id = EMPTY_RECORD_ID;
+   };
 
-   record_id_t get_record_id() const;
+   split_t insert(record_id_t& record_id, const key_t& key, const value_t& value, bool& inserted);
+   // The node may become larger than ORDER, the parent splits it
+   size_t insert(node_t& node, const entry_t* begin, const entry_t* end);
+   // Stores the node of the child of the parent, split into parts of at most ORDER size, which are added to the parent
+   void store_split(node_t& node, node_t& parent, size_t i_child);
+   size_t remove(node_t& node, const key_t* begin, const key_t* end);
+   // Merges underfull children with their neighbors or moves entries between them
+   void rebalance(node_t& node, std::vector<bool>& underfull);
+   // Returns false when max_count entries are collected or a key after last_key is found
+   bool collect(record_id_t record_id, const key_t* last_key, size_t max_count, std::vector<entry_t>& entries) const;
+
+   static void merge(node_t& left, const key_t& separator, node_t& right);
+   static void split(node_t& left, key_t& separator, node_t& right);
+   // Moves entries or children from the position to the right node
+   static void split(node_t& left, size_t position, key_t& separator, node_t& right);
+   static size_t find_child(const node_t& node, const key_t& key);
+
+   void load(node_t& node, record_id_t record_id) const;
+   record_id_t store(const node_t& node, record_id_t record_id);
+   void save_meta();
 
-private:
    meta_t meta;
    record_id_t meta_record_id;
    mutable std::shared_ptr<VolumeFile> volume_file;
-
-   /* find index */
-   record_id_t search_index(const key_t& key) const;
-
-   /* find leaf */
-   record_id_t search_leaf(record_id_t index, const key_t& key) const;
-   record_id_t search_leaf(const key_t& key) const
-   {
-      return search_leaf(search_index(key), key);
-   }
-
-   /* remove internal node */
-   void remove_from_index(record_id_t offset, internal_node_t& node, const key_t& key);
-
-   /* borrow one key from other internal node */
-   bool borrow_key(bool from_right, internal_node_t& borrower, record_id_t offset);
-
-   /* borrow one record from other leaf */
-   bool borrow_key(bool from_right, leaf_node_t& borrower);
-
-   /* change one's parent key to another key */
-   void change_parent_child(record_id_t parent, const key_t& o, const key_t& n);
-
-   /* merge right leaf to left leaf */
-   void merge_leafs(leaf_node_t* left, leaf_node_t* right);
-
-   void merge_keys(index_t* where, internal_node_t& left, internal_node_t& right);
-
-   /* insert into leaf without split */
-   void insert_record_no_split(leaf_node_t *leaf, const key_t& key, const value_t& value);
-
-   /* add key to the internal node */
-   void insert_key_to_index(record_id_t offset, const key_t& key, record_id_t value, record_id_t after);
-   void insert_key_to_index_no_split(internal_node_t& node, const key_t& key, record_id_t value);
-
-   /* change children's parent */
-   void reset_index_children_parent(index_t* begin, index_t* end, record_id_t parent);
-
-   template<class T>
-   void node_create(record_id_t offset, T* node, T* next);
-
-   template<class T>
-   void node_remove(T* prev, T* node);
-
-   record_id_t alloc(leaf_node_t* leaf)
-   {
-      leaf->n = 0;
-      meta.leaf_node_num++;
-      return EMPTY_RECORD_ID;
-   }
-
-   record_id_t alloc(internal_node_t* node)
-   {
-      node->n = 1;
-      meta.internal_node_num++;
-      return EMPTY_RECORD_ID;
-   }
-
-   void unalloc(leaf_node_t* leaf, record_id_t record_id)
-   {
-      --meta.leaf_node_num;
-      volume_file->delete_record(record_id);
-   }
-
-   void unalloc(internal_node_t* node, record_id_t record_id)
-   {
-      --meta.internal_node_num;
-      volume_file->delete_record(record_id);
-   }
-
-   template<class T>
-   void map(T* block, record_id_t record_id) const;
-
-   template<class T>
-   void unmap(T* block, record_id_t& record_id);
-
-   static index_t* find(internal_node_t& node, const key_t& key);
-   static record_t* find(leaf_node_t& node, const key_t& key);
 };
 
 }
 
-#endif 
\ No newline at end of file
+#endif
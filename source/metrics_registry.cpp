@@ -0,0 +1,303 @@
+#include <array>
+#include <algorithm>
+#include <iterator>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+#include "metrics_registry.h"
+
+namespace hks {
+
+// Log-linear buckets like in HDR histograms: values below 8 have own buckets,
+// each next power of 2 range is split into 8 buckets
+static const size_t SUB_BUCKETS_COUNT = 8;
+static const size_t SUB_BUCKET_BITS = 3;
+static const size_t BUCKETS_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS_COUNT;
+
+static const char* COUNTER_NAMES[] = {
+   "node_loads",
+   "node_saves",
+   "record_reads",
+   "record_writes",
+   "record_allocations",
+   "record_relocations",
+   "record_deletions",
+   "time_to_live_removals",
+   "lock_waits"
+};
+
+static const char* HISTOGRAM_NAMES[] = {
+   "storage.get_node",
+   "storage.add_node",
+   "storage.remove_node",
+   "storage.rename_node",
+   "storage.get_property",
+   "storage.set_property",
+   "storage.remove_property",
+   "storage.get_properties",
+   "storage.set_properties",
+   "storage.apply",
+   "node.load",
+   "node.save",
+   "volume_file.read_record",
+   "volume_file.write_record",
+   "volume_file.allocate_record",
+   "time_to_live.removal",
+   "lock_wait"
+};
+
+static_assert(sizeof(COUNTER_NAMES) / sizeof(COUNTER_NAMES[0]) == size_t(Counter::COUNT), "Counter name is missing");
+static_assert(sizeof(HISTOGRAM_NAMES) / sizeof(HISTOGRAM_NAMES[0]) == size_t(Histogram::COUNT), "Histogram name is missing");
+
+static size_t floor_log2(uint64_t value)
+{
+   size_t result = 0;
+   for (size_t shift = 32; shift > 0; shift /= 2) {
+      if (value >> shift) {
+         value >>= shift;
+         result += shift;
+      }
+   }
+   return result;
+}
+
+static size_t get_bucket(uint64_t value)
+{
+   if (value < SUB_BUCKETS_COUNT) {
+      return size_t(value);
+   }
+
+   size_t exponent = floor_log2(value);
+   size_t sub_bucket = size_t(value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS_COUNT - 1);
+   return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS_COUNT + sub_bucket;
+}
+
+static uint64_t get_bucket_value(size_t bucket)
+{
+   if (bucket < SUB_BUCKETS_COUNT) {
+      return bucket;
+   }
+
+   size_t exponent = bucket / SUB_BUCKETS_COUNT + SUB_BUCKET_BITS - 1;
+   uint64_t sub_bucket = bucket % SUB_BUCKETS_COUNT;
+   uint64_t lower_bound = (SUB_BUCKETS_COUNT + sub_bucket) << (exponent - SUB_BUCKET_BITS);
+   uint64_t width = uint64_t(1) << (exponent - SUB_BUCKET_BITS);
+   return lower_bound + width / 2;
+}
+
+// Each value is written only by the thread owning the shard, so updates are plain loads and stores,
+// atomics only make reading by snapshots safe
+static void add(std::atomic<uint64_t>& value, uint64_t delta)
+{
+   value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+struct HistogramShard
+{
+   std::atomic<uint64_t> total = 0;
+   std::atomic<uint64_t> max = 0;
+   std::array<std::atomic<uint64_t>, BUCKETS_COUNT> buckets = {};
+};
+
+struct MetricsShard
+{
+   std::array<std::atomic<uint64_t>, size_t(Counter::COUNT)> counters = {};
+   std::array<HistogramShard, size_t(Histogram::COUNT)> histograms;
+};
+
+// Shards of exited threads are merged into the retired one and freed, so their metrics are not lost
+class MetricsRegistry
+{
+public:
+   MetricsShard& get_thread_shard();
+
+   MetricsShard* add_shard()
+   {
+      std::lock_guard<std::mutex> locker(lock);
+      shards.push_back(std::make_unique<MetricsShard>());
+      return shards.back().get();
+   }
+
+   void retire_shard(MetricsShard* shard)
+   {
+      std::lock_guard<std::mutex> locker(lock);
+      for (size_t i = 0; i < shard->counters.size(); i++) {
+         add(retired.counters[i], shard->counters[i].load(std::memory_order_relaxed));
+      }
+      for (size_t i = 0; i < shard->histograms.size(); i++) {
+         HistogramShard& histogram_shard = shard->histograms[i];
+         HistogramShard& retired_histogram = retired.histograms[i];
+         add(retired_histogram.total, histogram_shard.total.load(std::memory_order_relaxed));
+         if (histogram_shard.max.load(std::memory_order_relaxed) > retired_histogram.max.load(std::memory_order_relaxed)) {
+            retired_histogram.max.store(histogram_shard.max.load(std::memory_order_relaxed), std::memory_order_relaxed);
+         }
+         for (size_t i_bucket = 0; i_bucket < BUCKETS_COUNT; i_bucket++) {
+            add(retired_histogram.buckets[i_bucket], histogram_shard.buckets[i_bucket].load(std::memory_order_relaxed));
+         }
+      }
+
+      shards.erase(std::find_if(shards.begin(), shards.end(), [shard](const std::unique_ptr<MetricsShard>& registered_shard) {
+         return registered_shard.get() == shard;
+      }));
+   }
+
+   MetricsSnapshot get_snapshot()
+   {
+      std::vector<uint64_t> counters(size_t(Counter::COUNT));
+      std::vector<std::vector<uint64_t>> buckets(size_t(Histogram::COUNT), std::vector<uint64_t>(BUCKETS_COUNT));
+      std::vector<HistogramSnapshot> histograms(size_t(Histogram::COUNT));
+
+      auto add_shard_metrics = [&](const MetricsShard& shard) {
+         for (size_t i = 0; i < counters.size(); i++) {
+            counters[i] += shard.counters[i].load(std::memory_order_relaxed);
+         }
+         for (size_t i = 0; i < histograms.size(); i++) {
+            const HistogramShard& histogram_shard = shard.histograms[i];
+            histograms[i].total += std::chrono::nanoseconds(histogram_shard.total.load(std::memory_order_relaxed));
+            histograms[i].max = std::max(histograms[i].max, std::chrono::nanoseconds(histogram_shard.max.load(std::memory_order_relaxed)));
+            for (size_t i_bucket = 0; i_bucket < BUCKETS_COUNT; i_bucket++) {
+               uint64_t bucket_count = histogram_shard.buckets[i_bucket].load(std::memory_order_relaxed);
+               buckets[i][i_bucket] += bucket_count;
+               histograms[i].count += bucket_count;
+            }
+         }
+      };
+
+      {
+         std::lock_guard<std::mutex> locker(lock);
+         for (auto& shard : shards) {
+            add_shard_metrics(*shard);
+         }
+         add_shard_metrics(retired);
+      }
+
+      MetricsSnapshot snapshot;
+      for (size_t i = 0; i < counters.size(); i++) {
+         snapshot.counters[COUNTER_NAMES[i]] = counters[i];
+      }
+      for (size_t i = 0; i < histograms.size(); i++) {
+         set_percentiles(histograms[i], buckets[i]);
+         snapshot.histograms[HISTOGRAM_NAMES[i]] = histograms[i];
+      }
+      return snapshot;
+   }
+
+private:
+   static void set_percentiles(HistogramSnapshot& histogram, const std::vector<uint64_t>& buckets)
+   {
+      std::pair<double, std::chrono::nanoseconds*> percentiles[] = {
+         { 0.5, &histogram.p50 },
+         { 0.9, &histogram.p90 },
+         { 0.99, &histogram.p99 },
+         { 0.999, &histogram.p999 }
+      };
+
+      uint64_t seen_count = 0;
+      size_t i_percentile = 0;
+      for (size_t i_bucket = 0; i_bucket < buckets.size() && i_percentile < std::size(percentiles); i_bucket++) {
+         seen_count += buckets[i_bucket];
+         while (i_percentile < std::size(percentiles) && seen_count > 0 && seen_count >= percentiles[i_percentile].first * histogram.count) {
+            *percentiles[i_percentile].second = std::min(std::chrono::nanoseconds(get_bucket_value(i_bucket)), histogram.max);
+            i_percentile++;
+         }
+      }
+   }
+
+   std::mutex lock;
+   std::vector<std::unique_ptr<MetricsShard>> shards;
+   // Written only under the lock
+   MetricsShard retired;
+};
+
+static MetricsRegistry& get_registry()
+{
+   // Never destroyed, threads could record metrics while static objects are destroyed
+   static MetricsRegistry* registry = new MetricsRegistry();
+   return *registry;
+}
+
+// Plain pointer, so it can be read by destructors of thread locals after the retirer is destroyed
+static thread_local MetricsShard* thread_shard = nullptr;
+
+struct ThreadShardRetirer
+{
+   ~ThreadShardRetirer()
+   {
+      get_registry().retire_shard(thread_shard);
+      thread_shard = nullptr;
+   }
+};
+
+MetricsShard& MetricsRegistry::get_thread_shard()
+{
+   if (thread_shard == nullptr) {
+      thread_shard = add_shard();
+      // Metrics recorded on the thread exit after the retirer is destroyed get a new shard, which stays registered
+      static thread_local ThreadShardRetirer retirer;
+   }
+   return *thread_shard;
+}
+
+namespace metrics {
+
+void increment(Counter counter, uint64_t value)
+{
+   add(get_registry().get_thread_shard().counters[size_t(counter)], value);
+}
+
+void record(Histogram histogram, std::chrono::nanoseconds duration)
+{
+   uint64_t value = duration.count() > 0 ? uint64_t(duration.count()) : 0;
+   HistogramShard& shard = get_registry().get_thread_shard().histograms[size_t(histogram)];
+   add(shard.buckets[get_bucket(value)], 1);
+   add(shard.total, value);
+   if (value > shard.max.load(std::memory_order_relaxed)) {
+      shard.max.store(value, std::memory_order_relaxed);
+   }
+}
+
+}
+
+MetricsSnapshot get_metrics()
+{
+   return get_registry().get_snapshot();
+}
+
+ScopedTimer::ScopedTimer(Histogram histogram)
+   : histogram(histogram)
+   , start(std::chrono::steady_clock::now())
+{
+}
+
+ScopedTimer::~ScopedTimer()
+{
+   metrics::record(histogram, std::chrono::steady_clock::now() - start);
+}
+
+void MeteredSharedMutex::lock()
+{
+   if (mutex.try_lock()) {
+      return;
+   }
+
+   auto start = std::chrono::steady_clock::now();
+   mutex.lock();
+   metrics::increment(Counter::lock_waits);
+   metrics::record(Histogram::lock_wait, std::chrono::steady_clock::now() - start);
+}
+
+void MeteredSharedMutex::lock_shared()
+{
+   if (mutex.try_lock_shared()) {
+      return;
+   }
+
+   auto start = std::chrono::steady_clock::now();
+   mutex.lock_shared();
+   metrics::increment(Counter::lock_waits);
+   metrics::record(Histogram::lock_wait, std::chrono::steady_clock::now() - start);
+}
+
+}
@@ -0,0 +1,92 @@
+#ifndef HKEYSTORE_METRICS_REGISTRY_H
+#define HKEYSTORE_METRICS_REGISTRY_H
+
+#include <cstdint>
+#include <chrono>
+#include <shared_mutex>
+
+#include <metrics.h>
+
+namespace hks {
+
+enum class Counter
+{
+   node_loads,
+   node_saves,
+   record_reads,
+   record_writes,
+   record_allocations,
+   record_relocations,
+   record_deletions,
+   time_to_live_removals,
+   lock_waits,
+   COUNT
+};
+
+enum class Histogram
+{
+   storage_get_node,
+   storage_add_node,
+   storage_remove_node,
+   storage_rename_node,
+   storage_get_property,
+   storage_set_property,
+   storage_remove_property,
+   storage_get_properties,
+   storage_set_properties,
+   storage_apply,
+   node_load,
+   node_save,
+   record_read,
+   record_write,
+   record_allocation,
+   // Removal of the expired children of one parent
+   time_to_live_removal,
+   lock_wait,
+   COUNT
+};
+
+// Metrics are written to per-thread shards without synchronization between threads,
+// so they could be updated on every operation
+
+namespace metrics {
+
+void increment(Counter counter, uint64_t value = 1);
+void record(Histogram histogram, std::chrono::nanoseconds duration);
+
+}
+
+// Records the time of its scope into a histogram
+class ScopedTimer
+{
+public:
+   explicit ScopedTimer(Histogram histogram);
+   ~ScopedTimer();
+
+   ScopedTimer(const ScopedTimer&) = delete;
+   void operator=(const ScopedTimer&) = delete;
+
+private:
+   Histogram histogram;
+   std::chrono::steady_clock::time_point start;
+};
+
+// Shared mutex counting waits for the lock, uncontended locking is not timed
+class MeteredSharedMutex
+{
+public:
+   void lock();
+   bool try_lock() { return mutex.try_lock(); }
+   void unlock() { mutex.unlock(); }
+
+   void lock_shared();
+   bool try_lock_shared() { return mutex.try_lock_shared(); }
+   void unlock_shared() { mutex.unlock_shared(); }
+
+private:
+   std::shared_mutex mutex;
+};
+
+}
+
+#endif
@@ -58,11 +58,41 @@ bool Node::remove_property(const std::string& name)
    return static_cast<NodeImpl*>(this)->remove_property_impl(name);
 }
 
+bool Node::set_property_time_to_live(const std::string& name, std::chrono::milliseconds time)
+{
+   return static_cast<NodeImpl*>(this)->set_property_time_to_live_impl(name, time);
+}
+
+void Node::apply(const Batch& batch)
+{
+   static_cast<NodeImpl*>(this)->apply_impl(batch);
+}
+
 void Node::set_time_to_live(std::chrono::milliseconds time)
 {
    return static_cast<NodeImpl*>(this)->set_time_to_live(time);
 }
 
+void Node::set_sliding_time_to_live(std::chrono::milliseconds time)
+{
+   return static_cast<NodeImpl*>(this)->set_sliding_time_to_live(time);
+}
+
+void Node::set_children_time_to_live(std::chrono::milliseconds time)
+{
+   static_cast<NodeImpl*>(this)->set_children_time_to_live_impl(time);
+}
+
+void Node::set_children_time_to_live(const std::vector<std::pair<std::string, std::chrono::milliseconds>>& times)
+{
+   static_cast<NodeImpl*>(this)->set_children_time_to_live_impl(times);
+}
+
+void Node::touch()
+{
+   static_cast<NodeImpl*>(this)->touch();
+}
+
 bool Node::get_property(const std::string& name, int& value) const
 {
    return static_cast<const NodeImpl*>(this)->get_property_impl(name, value);
@@ -110,7 +140,11 @@ bool Node::get_property(const std::string& name, std::vector<char>& value) const
 
 std::shared_ptr<Node> Node::get_child(const std::string& name)
 {
-   return static_cast<NodeImpl*>(this)->get_child_impl(name);
+   std::shared_ptr<NodeImpl> child = static_cast<NodeImpl*>(this)->get_child_impl(name);
+   if (child) {
+      child->touch();
+   }
+   return child;
 }
 
 std::shared_ptr<Node> Node::add_child(const std::string& name)
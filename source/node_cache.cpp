@@ -0,0 +1,82 @@
+#include <thread>
+
+#include "node_cache.h"
+#include "node_impl.h"
+
+namespace hks {
+
+NodeCache::NodeCache(size_t max_size)
+   : max_size(max_size)
+{
+}
+
+void NodeCache::node_used(NodeImpl& node)
+{
+   if (!node.recently_used.load(std::memory_order_relaxed)) {
+      node.recently_used.store(true, std::memory_order_relaxed);
+   }
+
+   static thread_local size_t i_counter = std::hash<std::thread::id>()(std::this_thread::get_id()) % HIT_COUNTERS_COUNT;
+   hits[i_counter].value.fetch_add(1, std::memory_order_relaxed);
+}
+
+void NodeCache::node_loaded(std::shared_ptr<NodeImpl> node)
+{
+   misses.fetch_add(1, std::memory_order_relaxed);
+   insert(std::move(node));
+}
+
+void NodeCache::node_added(std::shared_ptr<NodeImpl> node)
+{
+   insert(std::move(node));
+}
+
+NodeCacheStatistics NodeCache::get_statistics() const
+{
+   NodeCacheStatistics statistics;
+   for (auto& counter : hits) {
+      statistics.hits += counter.value.load(std::memory_order_relaxed);
+   }
+   statistics.misses = misses.load(std::memory_order_relaxed);
+   statistics.evictions = evictions.load(std::memory_order_relaxed);
+
+   lock_guard locker(lock);
+   statistics.nodes_count = entries.size();
+   statistics.size = size;
+   return statistics;
+}
+
+void NodeCache::insert(std::shared_ptr<NodeImpl> node)
+{
+   // Evicted nodes are released after the lock, destroying them may release their parents
+   std::vector<std::shared_ptr<NodeImpl>> evicted_nodes;
+
+   lock_guard locker(lock);
+
+   size_t node_size = node->serialized_size;
+   node->recently_used.store(true, std::memory_order_relaxed);
+   entries.push_back({ std::move(node), node_size });
+   size += node_size;
+
+   while (size > max_size && !entries.empty()) {
+      if (hand >= entries.size()) {
+         hand = 0;
+      }
+
+      Entry& entry = entries[hand];
+      if (entry.node->recently_used.exchange(false, std::memory_order_relaxed)) {
+         ++hand;
+         continue;
+      }
+
+      size -= entry.size;
+      evicted_nodes.push_back(std::move(entry.node));
+      if (hand + 1 != entries.size()) {
+         entry = std::move(entries.back());
+      }
+      entries.pop_back();
+      evictions.fetch_add(1, std::memory_order_relaxed);
+   }
+}
+
+}
@@ -0,0 +1,69 @@
+#ifndef HKEYSTORE_NODE_CACHE_H
+#define HKEYSTORE_NODE_CACHE_H
+
+#include <memory>
+#include <vector>
+#include <array>
+#include <mutex>
+#include <atomic>
+
+#include <volume.h>
+
+namespace hks {
+
+class NodeImpl;
+
+// Keeps recently used nodes of a volume loaded
+//
+// Parents reference their children weakly, so without the cache a node is read from the volume file
+// each time it's accessed after the last reference to it was dropped.
+// Nodes are evicted by the CLOCK algorithm: access only sets the used flag of the node,
+// eviction skips nodes with the flag set and clears it. Node size is its serialized size
+
+class NodeCache
+{
+public:
+   explicit NodeCache(size_t max_size);
+
+   NodeCache(const NodeCache&) = delete;
+   void operator=(const NodeCache&) = delete;
+
+   void node_used(NodeImpl& node);
+   void node_loaded(std::shared_ptr<NodeImpl> node);
+   void node_added(std::shared_ptr<NodeImpl> node);
+
+   NodeCacheStatistics get_statistics() const;
+
+private:
+   using lock_guard = std::lock_guard<std::mutex>;
+
+   static const size_t HIT_COUNTERS_COUNT = 16;
+
+   struct Entry
+   {
+      std::shared_ptr<NodeImpl> node;
+      size_t size;
+   };
+
+   // Hits are counted on every child access, so threads use separate counters
+   struct alignas(64) HitCounter
+   {
+      std::atomic<uint64_t> value = 0;
+   };
+
+   void insert(std::shared_ptr<NodeImpl> node);
+
+   mutable std::mutex lock;
+   std::vector<Entry> entries;
+   size_t hand = 0;
+   size_t size = 0;
+   size_t max_size;
+
+   std::array<HitCounter, HIT_COUNTERS_COUNT> hits;
+   std::atomic<uint64_t> misses = 0;
+   std::atomic<uint64_t> evictions = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,79 @@
+#include <algorithm>
+
+#include "node_flusher.h"
+#include "node_impl.h"
+
+namespace hks {
+
+NodeFlusher::NodeFlusher(std::chrono::milliseconds flush_interval, size_t max_dirty_bytes)
+   : flush_interval(flush_interval)
+   , max_dirty_bytes(max_dirty_bytes)
+{
+   thread = std::thread(&NodeFlusher::worker_function, this);
+}
+
+NodeFlusher::~NodeFlusher()
+{
+   {
+      lock_guard locker(lock);
+      exit = true;
+   }
+
+   work_ready.notify_all();
+   thread.join();
+   flush();
+}
+
+void NodeFlusher::node_changed(std::shared_ptr<NodeImpl> node, record_id_t record_id, size_t size)
+{
+   bool limit_exceeded;
+   {
+      lock_guard locker(lock);
+      dirty_nodes.push_back({ node, record_id });
+      dirty_bytes += size;
+      limit_exceeded = dirty_bytes > max_dirty_bytes;
+   }
+
+   if (limit_exceeded) {
+      work_ready.notify_all();
+   }
+}
+
+void NodeFlusher::flush()
+{
+   // Only one batch is written at a time, so flush() returns after all nodes changed before the call are written
+   lock_guard flush_locker(flush_lock);
+
+   std::vector<DirtyNode> nodes_to_flush;
+   {
+      lock_guard locker(lock);
+      nodes_to_flush.swap(dirty_nodes);
+      dirty_bytes = 0;
+   }
+
+   // Write records in the file order
+   std::sort(nodes_to_flush.begin(), nodes_to_flush.end(), [](const DirtyNode& lhs, const DirtyNode& rhs) {
+      return VolumeFile::get_record_offset(lhs.record_id) < VolumeFile::get_record_offset(rhs.record_id);
+   });
+
+   for (auto& dirty_node : nodes_to_flush) {
+      dirty_node.node->flush();
+   }
+}
+
+void NodeFlusher::worker_function()
+{
+   while (true) {
+      {
+         std::unique_lock<std::mutex> locker(lock);
+         work_ready.wait_for(locker, flush_interval, [&]() { return exit || dirty_bytes > max_dirty_bytes; });
+         if (exit) {
+            return;
+         }
+      }
+
+      flush();
+   }
+}
+
+}
@@ -0,0 +1,58 @@
+#ifndef HKEYSTORE_NODE_FLUSHER_H
+#define HKEYSTORE_NODE_FLUSHER_H
+
+#include <memory>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "volume_file.h"
+
+namespace hks {
+
+class NodeImpl;
+
+// Writes changed nodes of a volume opened in write-back mode
+//
+// Changed nodes are collected and written by a background thread in batches, ordered by record offset,
+// either every flush interval or when the total size of changed nodes exceeds the limit
+
+class NodeFlusher
+{
+public:
+   NodeFlusher(std::chrono::milliseconds flush_interval, size_t max_dirty_bytes);
+   ~NodeFlusher();
+
+   NodeFlusher(const NodeFlusher&) = delete;
+   void operator=(const NodeFlusher&) = delete;
+
+   void node_changed(std::shared_ptr<NodeImpl> node, record_id_t record_id, size_t size);
+   void flush();
+
+   void worker_function();
+
+private:
+   using lock_guard = std::lock_guard<std::mutex>;
+
+   struct DirtyNode
+   {
+      std::shared_ptr<NodeImpl> node;
+      record_id_t record_id;
+   };
+
+   std::mutex lock;
+   std::mutex flush_lock;
+   std::condition_variable work_ready;
+   bool exit = false;
+   std::vector<DirtyNode> dirty_nodes;
+   size_t dirty_bytes = 0;
+   std::chrono::milliseconds flush_interval;
+   size_t max_dirty_bytes;
+   std::thread thread;
+};
+
+}
+
+#endif
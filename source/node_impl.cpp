@@ -1,5 +1,7 @@
 #include <sstream>
 #include <cassert>
+#include <unordered_set>
+#include <algorithm>
 
 #include <errors.h>
 
@@ -7,9 +9,13 @@
 #include "utility.h"
 #include "time_to_live_manager.h"
 #include "serialization.h"
+#include "metrics_registry.h"
+#include "trace_scope.h"
 
 namespace hks {
 
+std::atomic<uint64_t> NodeImpl::paths_version{ 0 };
+
 struct RemoveBlobPropertyVisitor 
 {
    RemoveBlobPropertyVisitor(std::shared_ptr<VolumeFile> volume_file);
@@ -26,6 +32,22 @@ RemoveBlobPropertyVisitor::RemoveBlobPropertyVisitor(std::shared_ptr<VolumeFile>
 {
 }
 
+struct ReleaseBlobPropertyVisitor
+{
+   ReleaseBlobPropertyVisitor(std::vector<BlobProperty>& released_blobs);
+
+   template<typename T>
+   void operator()(const T&) const {}
+   void operator()(BlobProperty& blobProperty) const { released_blobs.push_back(blobProperty); }
+private:
+   std::vector<BlobProperty>& released_blobs;
+};
+
+ReleaseBlobPropertyVisitor::ReleaseBlobPropertyVisitor(std::vector<BlobProperty>& released_blobs)
+   : released_blobs(released_blobs)
+{
+}
+
 NodeImpl::NodeImpl(std::shared_ptr<NodeImpl> parent, VolumeImpl* volume_impl)
    : parent(parent)
    , volume_impl(volume_impl)
@@ -34,120 +56,424 @@ NodeImpl::NodeImpl(std::shared_ptr<NodeImpl> parent, VolumeImpl* volume_impl)
    save(true);
 }
 
-NodeImpl::NodeImpl(std::shared_ptr<NodeImpl> parent, VolumeImpl* volume_impl, record_id_t record_id)
-   : parent(parent)
+NodeImpl::NodeImpl(std::shared_ptr<NodeImpl> parent, VolumeImpl* volume_impl, node_id_t node_id)
+   : node_id(node_id)
+   , parent(parent)
    , volume_impl(volume_impl)
-   , record_id(record_id)
 {
+   record_id = volume_impl->get_node_records_table()->get_node_record_id(node_id);
    load();
 }
 
-std::shared_ptr<NodeImpl> NodeImpl::get_child_impl(const std::string& name)
+std::shared_ptr<NodeImpl> NodeImpl::get_child_impl(std::string_view name)
 {
+   // Expired children are absent for reads before the time to live manager removes them
+   std::shared_ptr<NodeImpl> child = find_child(name);
+   return child && !child->is_expired() ? child : nullptr;
+}
+
+std::shared_ptr<NodeImpl> NodeImpl::find_child(std::string_view name)
+{
+   {
+      shared_lock locker(lock);
+      bool exists;
+      std::shared_ptr<NodeImpl> child = find_loaded_child(name, exists);
+      if (child || !exists) {
+         return child;
+      }
+   }
+
+   // Child has to be loaded
    lock_guard locker(lock);
    return do_get_child(name);
 }
 
 template<typename T>
-void NodeImpl::set_property_impl(const std::string& name, const T& value)
+bool NodeImpl::convert_property(const PropertyValue& property_value, T& value) const
 {
-   if (name.find('.') != std::string::npos) {
-      throw LogicError("Can't add property with name '" + name + "'. Property names can't contain dots");
+   return std::visit([&](auto&& stored_value) {
+      return TypeConverter::convert<std::decay_t<decltype(stored_value)>, std::decay_t<T>>(stored_value, value);
+   }, property_value);
+}
+
+template<>
+bool NodeImpl::convert_property<std::vector<char>>(const PropertyValue& property_value, std::vector<char>& value) const
+{
+   BlobProperty blob_property;
+   bool res = std::visit([&](auto&& stored_value) {
+      return TypeConverter::convert<std::decay_t<decltype(stored_value)>, BlobProperty>(stored_value, blob_property);
+   }, property_value);
+
+   if (res) {
+      value = blob_property.load(volume_impl->get_volume_file());
    }
+   return res;
+}
 
-   lock_guard locker(lock);
-   auto it = properties.find(name);
-   if (it == properties.end()) {
-      properties.insert({ name, value });
-   } else {
-      std::visit(RemoveBlobPropertyVisitor(volume_impl->get_volume_file()), it->second);
-      it->second = value;
+template<typename T>
+void NodeImpl::set_property_impl(std::string_view name, const T& value)
+{
+   if (name.find('.') != std::string_view::npos) {
+      throw LogicError("Can't add property with name '" + std::string(name) + "'. Property names can't contain dots");
    }
+
+   PropertySlot slot;
+   set_property_impl(slot, name, value);
+}
+
+template<typename T>
+void NodeImpl::set_property_impl(PropertySlot& slot, std::string_view name, const T& value)
+{
+   lock_guard locker(lock);
+   do_set_property(slot, name, value);
    update();
 }
 
-bool NodeImpl::remove_property_impl(const std::string& name)
+bool NodeImpl::remove_property_impl(std::string_view name)
 {
    lock_guard locker(lock);
 
-   auto it = properties.find(name);
-   if (it == properties.end()) {
+   bool expired = is_property_expired(name);
+   if (!do_remove_property(name)) {
       return false;
    }
 
-   std::visit(RemoveBlobPropertyVisitor(volume_impl->get_volume_file()), it->second);
-   properties.erase(it);
+   update();
+   return !expired;
+}
+
+bool NodeImpl::set_property_time_to_live_impl(std::string_view name, std::chrono::milliseconds time)
+{
+   lock_guard locker(lock);
+   std::string property_name(name);
+   if (properties.count(property_name) == 0 || is_property_expired(property_name)) {
+      return false;
+   }
 
+   timepoint previous_time_to_remove;
+   timepoint& time_to_remove = property_times_to_remove[property_name];
+   std::swap(previous_time_to_remove, time_to_remove);
+   time_to_remove = std::chrono::system_clock::now() + time;
    update();
+
+   volume_impl->get_time_to_live_manager()->set_property_time_to_remove(node_id, get_property_name_hash(property_name), time_to_remove,
+      previous_time_to_remove);
    return true;
 }
 
+size_t NodeImpl::remove_expired_properties(const std::vector<uint64_t>& property_hashes, timepoint now)
+{
+   lock_guard locker(lock);
+   if (volume_impl == nullptr) {
+      return 0;
+   }
+
+   // Properties with equal name hashes share a timer, each of them is checked
+   std::vector<std::string> expired_names;
+   for (auto& property_time : property_times_to_remove) {
+      uint64_t property_hash = get_property_name_hash(property_time.first);
+      if (std::find(property_hashes.begin(), property_hashes.end(), property_hash) == property_hashes.end()) {
+         continue;
+      }
+      if (property_time.second > now) {
+         // Its key was removed with the expired ones
+         volume_impl->get_time_to_live_manager()->set_property_time_to_remove(node_id, property_hash, property_time.second, timepoint());
+         continue;
+      }
+      expired_names.push_back(property_time.first);
+   }
+
+   for (auto& name : expired_names) {
+      do_remove_property(name);
+   }
+   if (!expired_names.empty()) {
+      update();
+   }
+   return expired_names.size();
+}
+
+void NodeImpl::apply_property_changes(const std::vector<PropertyChange>& changes)
+{
+   for (auto& change : changes) {
+      if (change.name.find('.') != std::string::npos) {
+         throw LogicError("Can't add property with name '" + change.name + "'. Property names can't contain dots");
+      }
+   }
+
+   lock_guard locker(lock);
+
+   bool changed = false;
+   for (auto& change : changes) {
+      if (!change.value) {
+         changed |= do_remove_property(change.name);
+         continue;
+      }
+
+      std::visit([&](auto&& value) {
+         using T = std::decay_t<decltype(value)>;
+         if constexpr (std::is_same_v<T, std::vector<char>>) {
+            BlobProperty blob_property;
+            blob_property.store(volume_impl->get_volume_file(), value.data(), value.size());
+            do_set_property(change.name, blob_property);
+         } else {
+            do_set_property(change.name, value);
+         }
+      }, *change.value);
+      changed = true;
+   }
+
+   if (changed) {
+      update();
+   }
+}
+
+void NodeImpl::get_property_values(const std::vector<PropertyRead>& reads) const
+{
+   shared_lock locker(lock);
+
+   for (auto& read : reads) {
+      auto it = properties.find(lookup_key(read.name));
+      if (it == properties.end() || is_property_expired(it->first)) {
+         continue;
+      }
+
+      std::visit([&](auto&& value) {
+         using T = std::decay_t<decltype(value)>;
+         if constexpr (std::is_same_v<T, BlobProperty>) {
+            BlobProperty blob_property = value;
+            *read.value = blob_property.load(volume_impl->get_volume_file());
+         } else {
+            *read.value = value;
+         }
+      }, it->second);
+   }
+}
+
+void NodeImpl::apply_impl(const Batch& batch)
+{
+   batch.apply([&](const std::string& path) { return get_node_impl(path); }, true);
+}
+
 void NodeImpl::set_time_to_live(std::chrono::milliseconds time)
+{
+   set_time_to_remove(std::chrono::system_clock::now() + time, std::chrono::milliseconds(0));
+}
+
+void NodeImpl::set_sliding_time_to_live(std::chrono::milliseconds time)
+{
+   set_time_to_remove(std::chrono::system_clock::now() + time, time);
+}
+
+void NodeImpl::set_children_time_to_live_impl(std::chrono::milliseconds time)
+{
+   lock_guard locker(lock);
+   std::vector<std::pair<std::string, std::chrono::milliseconds>> times;
+   times.reserve(nodes.size());
+   for (auto& child : nodes) {
+      times.emplace_back(child.first, time);
+   }
+   do_set_children_time_to_live(times);
+}
+
+void NodeImpl::set_children_time_to_live_impl(const std::vector<std::pair<std::string, std::chrono::milliseconds>>& times)
+{
+   lock_guard locker(lock);
+   for (auto& child_time : times) {
+      if (nodes.find(child_time.first) == nodes.end()) {
+         throw NoSuchNode("Node with name '" + child_time.first + "' doesn't exist");
+      }
+   }
+   do_set_children_time_to_live(times);
+}
+
+void NodeImpl::touch()
+{
+   if (idle_time.load(std::memory_order_relaxed) == 0) {
+      return;
+   }
+
+   shared_lock locker(lock);
+   std::chrono::milliseconds time(idle_time.load(std::memory_order_relaxed));
+   if (volume_impl == nullptr || time.count() == 0) {
+      return;
+   }
+   TimeToLiveManager* time_to_live_manager = volume_impl->get_time_to_live_manager();
+   if (!time_to_live_manager->touch(node_id)) {
+      // First access after the node was loaded
+      time_to_live_manager->set_sliding_node(node_id, time);
+   }
+}
+
+void NodeImpl::set_time_to_remove(timepoint time, std::chrono::milliseconds idle_time)
 {
    lock_guard locker(lock);
    if (parent == nullptr) {
       throw LogicError("Can't delete root node");
    }
    auto previous_time_to_remove = time_to_remove;
-   time_to_remove = std::chrono::system_clock::now() + time;
+   time_to_remove = time;
+   int64_t previous_idle_time = this->idle_time.exchange(idle_time.count(), std::memory_order_relaxed);
    update();
-   volume_impl->get_time_to_live_manager()->set_time_to_remove(get_unique_node_path(), time_to_remove, previous_time_to_remove);
+
+   TimeToLiveManager* time_to_live_manager = volume_impl->get_time_to_live_manager();
+   if (idle_time.count() != 0 || previous_idle_time != 0) {
+      time_to_live_manager->set_sliding_node(node_id, idle_time);
+   }
+   time_to_live_manager->set_time_to_remove(node_id, get_parent_node_id(), time_to_remove, previous_time_to_remove);
 }
 
-template<>
-void NodeImpl::set_property_impl<BlobHolder>(const std::string& name, const BlobHolder& blob)
+void NodeImpl::do_set_children_time_to_live(const std::vector<std::pair<std::string, std::chrono::milliseconds>>& times)
 {
-   if (name.find('.') != std::string::npos) {
-      throw LogicError("Can't add property with name '" + name + "'. Property names can't contain dots");
+   timepoint now = std::chrono::system_clock::now();
+   std::vector<TimeToLiveManager::TimeToRemove> times_to_remove;
+   times_to_remove.reserve(times.size());
+   for (auto& child_time : times) {
+      std::shared_ptr<NodeImpl> child = do_get_child(child_time.first);
+      timepoint time_to_remove = now + child_time.second;
+      times_to_remove.push_back({ child->node_id, time_to_remove, child->replace_time_to_remove(time_to_remove) });
    }
+   volume_impl->get_time_to_live_manager()->set_times_to_remove(node_id, times_to_remove);
+}
 
+NodeImpl::timepoint NodeImpl::replace_time_to_remove(timepoint time)
+{
    lock_guard locker(lock);
+   timepoint previous_time_to_remove = time_to_remove;
+   time_to_remove = time;
+   if (idle_time.exchange(0, std::memory_order_relaxed) != 0) {
+      volume_impl->get_time_to_live_manager()->set_sliding_node(node_id, std::chrono::milliseconds(0));
+   }
+   update();
+   return previous_time_to_remove;
+}
 
-   BlobProperty blob_property;
-   blob_property.store(volume_impl->get_volume_file(), blob.data, blob.size);
+bool NodeImpl::is_expired() const
+{
+   shared_lock locker(lock);
+   if (time_to_remove == timepoint()) {
+      return false;
+   }
+   timepoint now = std::chrono::system_clock::now();
+   if (time_to_remove > now) {
+      return false;
+   }
 
-   auto it = properties.find(name);
-   if (it == properties.end()) {
-      properties.insert({ name, blob_property });
-   } else {
-      std::visit(RemoveBlobPropertyVisitor(volume_impl->get_volume_file()), it->second);
-      it->second = blob_property;
+   // Sliding time to live is extended by accesses, which the manager hasn't applied yet
+   std::chrono::milliseconds time(idle_time.load(std::memory_order_relaxed));
+   timepoint last_access_time;
+   return time.count() == 0 || volume_impl == nullptr ||
+      !volume_impl->get_time_to_live_manager()->get_last_access_time(node_id, last_access_time) || last_access_time + time <= now;
+}
+
+bool NodeImpl::is_path_expired() const
+{
+   TimeToLiveManager* time_to_live_manager;
+   {
+      shared_lock locker(lock);
+      if (volume_impl == nullptr) {
+         return false;
+      }
+      time_to_live_manager = volume_impl->get_time_to_live_manager();
    }
-   update();
+   if (std::chrono::system_clock::now() < time_to_live_manager->get_first_expiry_time()) {
+      return false;
+   }
+
+   for (const NodeImpl* node = this; node != nullptr; node = node->parent.get()) {
+      if (node->is_expired()) {
+         return true;
+      }
+   }
+   return false;
 }
 
-template<typename T>
-bool NodeImpl::get_property_impl(const std::string& name, T& value) const
+void NodeImpl::path_changed()
+{
+   path_version.store(paths_version.fetch_add(1, std::memory_order_acq_rel) + 1, std::memory_order_release);
+}
+
+uint64_t NodeImpl::get_paths_version()
+{
+   return paths_version.load(std::memory_order_acquire);
+}
+
+bool NodeImpl::is_path_changed(uint64_t paths_version) const
+{
+   // Parents of nodes never change, so they are read without locks
+   for (const NodeImpl* node = this; node != nullptr; node = node->parent.get()) {
+      if (node->path_version.load(std::memory_order_acquire) > paths_version) {
+         return true;
+      }
+   }
+   return false;
+}
+
+bool NodeImpl::reschedule_time_to_remove(timepoint now)
 {
    lock_guard locker(lock);
-   auto it = properties.find(name);
-   if (it == properties.end()) {
+   if (volume_impl == nullptr) {
+      return false;
+   }
+
+   TimeToLiveManager* time_to_live_manager = volume_impl->get_time_to_live_manager();
+   timepoint previous_time_to_remove = time_to_remove;
+   std::chrono::milliseconds time(idle_time.load(std::memory_order_relaxed));
+   timepoint last_access_time;
+   if (time.count() != 0 && time_to_live_manager->get_last_access_time(node_id, last_access_time) &&
+      last_access_time + time > time_to_remove) {
+      time_to_remove = last_access_time + time;
+      update();
+   }
+
+   if (time_to_remove <= now) {
       return false;
    }
-   
-   return std::visit([&](auto&& property_value) {
-      return TypeConverter::convert<std::decay_t<decltype(property_value)>, std::decay_t<T>>(property_value, value);
-   }, it->second);
+   if (now != timepoint()) {
+      // The expired key is removed by the manager, so the new one has to be written at once as the first key
+      previous_time_to_remove = timepoint();
+   }
+   time_to_live_manager->set_time_to_remove(node_id, get_parent_node_id(), time_to_remove, previous_time_to_remove);
+   return true;
 }
 
-template<>
-bool NodeImpl::get_property_impl<std::vector<char>>(const std::string& name, std::vector<char>& value) const
+void NodeImpl::flush()
 {
    lock_guard locker(lock);
-   auto it = properties.find(name);
-   if (it == properties.end()) {
-      return false;
+   if (dirty) {
+      dirty = false;
+      save(false);
    }
+}
+
+template<>
+void NodeImpl::set_property_impl<BlobHolder>(PropertySlot& slot, std::string_view name, const BlobHolder& blob)
+{
+   lock_guard locker(lock);
 
    BlobProperty blob_property;
-   bool res = std::visit([&](auto&& property_value) {
-      return TypeConverter::convert<std::decay_t<decltype(property_value)>, BlobProperty>(property_value, blob_property);
-   }, it->second);
+   blob_property.store(volume_impl->get_volume_file(), blob.data, blob.size);
 
-   if (res) {
-      value = blob_property.load(volume_impl->get_volume_file());
+   do_set_property(slot, name, blob_property);
+   update();
+}
+
+template<typename T>
+bool NodeImpl::get_property_impl(std::string_view name, T& value) const
+{
+   PropertySlot slot;
+   return get_property_impl(slot, name, value);
+}
+
+template<typename T>
+bool NodeImpl::get_property_impl(PropertySlot& slot, std::string_view name, T& value) const
+{
+   shared_lock locker(lock);
+   const PropertyValue* property_value = find_property(slot, name);
+   if (!property_value || is_property_expired(name)) {
+      return false;
    }
-   return res;
+
+   return convert_property(*property_value, value);
 }
 
 std::shared_ptr<NodeImpl> NodeImpl::add_child_impl(const std::string& name)
@@ -157,31 +483,44 @@ std::shared_ptr<NodeImpl> NodeImpl::add_child_impl(const std::string& name)
    }
 
    lock_guard locker(lock);
-   if (nodes.find(name) != nodes.end()) {
+   if (has_child(name)) {
       throw NodeAlreadyExists("Node " + name + " already exists.");
    }
 
-   auto new_node = std::make_shared<NodeImpl>(shared_from_this(), volume_impl);
+   auto new_node = do_add_child(name);
+   update();
 
-   ChildNode child_node;
-   child_node.record_id = new_node->record_id;
-   child_node.node = new_node;
-   child_node.node_id = new_node->node_id;
+   return new_node;
+}
 
-   nodes.insert({ name, child_node });
-   child_names_by_ids.insert({ child_node.node_id, name });
+void NodeImpl::add_children_impl(const std::vector<std::string>& names)
+{
+   for (auto& name : names) {
+      if (name.find('.') != std::string::npos) {
+         throw LogicError("Can't add node with name '" + name + "'. Node names can't contain dots");
+      }
+   }
 
-   update();
+   lock_guard locker(lock);
+   std::unordered_set<std::string> new_names;
+   for (auto& name : names) {
+      if (has_child(name) || !new_names.insert(name).second) {
+         throw NodeAlreadyExists("Node " + name + " already exists.");
+      }
+   }
 
-   return new_node;
+   for (auto& name : names) {
+      do_add_child(name);
+   }
+   update();
 }
 
-std::shared_ptr<NodeImpl> NodeImpl::get_node_impl(const std::string& path)
+std::shared_ptr<NodeImpl> NodeImpl::get_node_impl(std::string_view path)
 {
    std::shared_ptr<NodeImpl> cur_node = shared_from_this();
    size_t i_path = 0;
    while (i_path < path.length()) {
-      std::string sub_key = find_next_sub_key(path, i_path);
+      std::string_view sub_key = find_next_sub_key(path, i_path);
       cur_node = cur_node->get_child_impl(sub_key);
       if (!cur_node) {
          return nullptr;
@@ -194,23 +533,30 @@ void NodeImpl::rename_child_impl(const std::string& name, const std::string& new
 {
    lock_guard locker(lock);
 
-   auto it = nodes.find(name);
-   if (it == nodes.end()) {
+   if (!has_child(name)) {
       throw NoSuchNode("Node with name '" + name + "' doesn't exist");
    }
-   if (nodes.find(new_name) != nodes.end()) {
+   if (has_child(new_name)) {
       throw NodeAlreadyExists("Node with name '" + name + "' already exists");
    }
+   auto it = nodes.find(name);
 
    node_id_t child_node_id = it->second.node_id;
 
    auto child_node_handler = nodes.extract(it);
    child_node_handler.key() = new_name;
-   nodes.insert(std::move(child_node_handler));
+   auto inserted = nodes.insert(std::move(child_node_handler));
 
    child_names_by_ids[child_node_id] = new_name;
+   update_path_hashes(inserted.position->second, get_child_path_hash(path_hash, name), get_child_path_hash(path_hash, new_name));
 
    update();
+   volume_impl->node_names_added();
+   // Nodes which aren't loaded have no cached paths
+   std::shared_ptr<NodeImpl> child = inserted.position->second.node.lock();
+   if (child) {
+      child->path_changed();
+   }
 }
 
 void NodeImpl::remove_child_impl(const std::string& name)
@@ -221,7 +567,7 @@ void NodeImpl::remove_child_impl(const std::string& name)
 
 bool NodeImpl::is_deleted_impl() const
 {
-   lock_guard locker(lock);
+   shared_lock locker(lock);
 
    return record_id == DELETED_NODE_RECORD_ID;
 }
@@ -233,6 +579,21 @@ node_id_t NodeImpl::get_node_id() const
 
 std::shared_ptr<NodeImpl> NodeImpl::get_child_impl(node_id_t node_id)
 {
+   {
+      shared_lock locker(lock);
+
+      auto it = child_names_by_ids.find(node_id);
+      if (it == child_names_by_ids.end()) {
+         return nullptr;
+      }
+
+      bool exists;
+      std::shared_ptr<NodeImpl> child = find_loaded_child(it->second, exists);
+      if (child) {
+         return child;
+      }
+   }
+
    lock_guard locker(lock);
 
    auto it = child_names_by_ids.find(node_id);
@@ -255,57 +616,207 @@ bool NodeImpl::remove_child_impl(node_id_t node_id)
    return true;
 }
 
-void NodeImpl::child_node_record_id_updated(node_id_t child_node_id, record_id_t new_record_id)
+size_t NodeImpl::remove_children_impl(const std::vector<node_id_t>& node_ids, timepoint now, SubtreeRemover& subtree_remover)
 {
    lock_guard locker(lock);
+   size_t removed_count = 0;
+   for (node_id_t node_id : node_ids) {
+      auto name_it = child_names_by_ids.find(node_id);
+      if (name_it == child_names_by_ids.end()) {
+         continue;
+      }
 
-   auto it = child_names_by_ids.find(child_node_id);
-   if (it == child_names_by_ids.end()) {
-      // Child has been deleted
-      return;
+      auto it = nodes.find(name_it->second);
+      std::shared_ptr<NodeImpl> removing_node = it->second.node.lock();
+      if (removing_node == nullptr) {
+         removing_node = std::make_shared<NodeImpl>(shared_from_this(), volume_impl, node_id);
+         removing_node->path_hash = get_child_path_hash(path_hash, it->first);
+      }
+
+      // Time to live was set again or the node was accessed after the expiry was found
+      if (removing_node->reschedule_time_to_remove(now)) {
+         continue;
+      }
+
+      // Node is deleted before it's detached, a crash in between doesn't leave its subtree unreachable
+      removing_node->path_changed();
+      subtree_remover.add(removing_node);
+      nodes.erase(it);
+      child_names_by_ids.erase(name_it);
+      removed_count++;
    }
 
-   const std::string& child_name = it->second;
-   nodes[child_name].record_id = new_record_id;
+   if (removed_count > 0) {
+      update();
+   }
+   return removed_count;
+}
 
-   save_nodes();
+node_id_t NodeImpl::get_parent_node_id() const
+{
+   return parent ? parent->node_id : NodeRecordsTable::NO_NODE_ID;
 }
 
-std::vector<node_id_t> NodeImpl::get_unique_node_path()
+std::shared_ptr<NodeImpl> NodeImpl::find_loaded_child(std::string_view name, bool& exists) const
 {
-   std::vector<std::shared_ptr<NodeImpl>> path_to_root;
-   std::shared_ptr<NodeImpl> node = shared_from_this();
-   while (node) {
-      path_to_root.push_back(node);
-      node = node->parent;
+   auto it = nodes.find(lookup_key(name));
+   exists = it != nodes.end();
+   if (!exists) {
+      return nullptr;
    }
 
-   std::vector<node_id_t> path;
-   for (size_t i = path_to_root.size(); i-- > 0; ) {
-      path.push_back(path_to_root[i]->node_id);
+   std::shared_ptr<NodeImpl> child = it->second.node.lock();
+   // Deleted node has no volume, its loaded children are still returned
+   NodeCache* node_cache = volume_impl ? volume_impl->get_node_cache() : nullptr;
+   if (child && node_cache) {
+      node_cache->node_used(*child);
    }
-   return path;
+   return child;
 }
 
-std::shared_ptr<NodeImpl> NodeImpl::do_get_child(const std::string& name)
+std::shared_ptr<NodeImpl> NodeImpl::do_get_child(std::string_view name)
 {
-   auto it = nodes.find(name);
+   auto it = nodes.find(lookup_key(name));
    if (it == nodes.end()) {
       return nullptr;
    }
 
    std::shared_ptr<NodeImpl> child = it->second.node.lock();
+   if (volume_impl == nullptr) {
+      // Node is deleted, children which aren't loaded can't be loaded anymore
+      return child;
+   }
+
+   NodeCache* node_cache = volume_impl->get_node_cache();
    if (!child) {
       // Node was not loaded. Load it.
-      child = std::make_shared<NodeImpl>(shared_from_this(), volume_impl, it->second.record_id);
+      child = std::make_shared<NodeImpl>(shared_from_this(), volume_impl, it->second.node_id);
+      child->path_hash = get_child_path_hash(path_hash, name);
       it->second.node = child;
-      assert(it->second.node_id == child->node_id);
+      if (node_cache) {
+         node_cache->node_loaded(child);
+      }
+   } else if (node_cache) {
+      node_cache->node_used(*child);
    }
 
    return child;
 }
 
+bool NodeImpl::has_child(const std::string& name)
+{
+   auto it = nodes.find(name);
+   if (it == nodes.end()) {
+      return false;
+   }
+
+   std::shared_ptr<NodeImpl> child = do_get_child(name);
+   if (!child->is_expired()) {
+      return true;
+   }
+
+   // Removed right away, the time to live manager skips it later
+   child->path_changed();
+   volume_impl->get_time_to_live_manager()->remove_subtree(child);
+   nodes.erase(it);
+   child_names_by_ids.erase(child->node_id);
+   update();
+   return false;
+}
+
+std::shared_ptr<NodeImpl> NodeImpl::do_add_child(const std::string& name)
+{
+   auto new_node = std::make_shared<NodeImpl>(shared_from_this(), volume_impl);
+   new_node->path_hash = get_child_path_hash(path_hash, name);
+   volume_impl->get_path_filter().add(new_node->path_hash);
+
+   ChildNode child_node;
+   child_node.node = new_node;
+   child_node.node_id = new_node->node_id;
+
+   nodes.insert({ name, child_node });
+   child_names_by_ids.insert({ child_node.node_id, name });
+   volume_impl->node_names_added();
+
+   NodeCache* node_cache = volume_impl->get_node_cache();
+   if (node_cache) {
+      node_cache->node_added(new_node);
+   }
+
+   return new_node;
+}
+
+void NodeImpl::do_set_property(std::string_view name, const PropertyValue& value)
+{
+   PropertySlot slot;
+   do_set_property(slot, name, value);
+}
+
+void NodeImpl::do_set_property(PropertySlot& slot, std::string_view name, const PropertyValue& value)
+{
+   PropertyValue* property_value = find_property(slot, name);
+   if (property_value) {
+      if (is_property_expired(name)) {
+         // Expired property is absent, the new one is set without the time to live
+         property_times_to_remove.erase(lookup_key(name));
+      }
+      std::visit(ReleaseBlobPropertyVisitor(released_blobs), *property_value);
+      *property_value = value;
+   } else {
+      auto it = properties.insert({ std::string(name), value }).first;
+      slot.value = &it->second;
+      slot.version = properties_version;
+   }
+}
+
+bool NodeImpl::do_remove_property(std::string_view name)
+{
+   auto it = properties.find(lookup_key(name));
+   if (it == properties.end()) {
+      return false;
+   }
+
+   std::visit(ReleaseBlobPropertyVisitor(released_blobs), it->second);
+   property_times_to_remove.erase(it->first);
+   properties.erase(it);
+   ++properties_version;
+   return true;
+}
+
+bool NodeImpl::is_property_expired(std::string_view name) const
+{
+   if (property_times_to_remove.empty()) {
+      return false;
+   }
+
+   auto it = property_times_to_remove.find(lookup_key(name));
+   return it != property_times_to_remove.end() && it->second <= std::chrono::system_clock::now();
+}
+
+NodeImpl::PropertyValue* NodeImpl::find_property(PropertySlot& slot, std::string_view name) const
+{
+   if (slot.value && slot.version == properties_version) {
+      return slot.value;
+   }
+
+   auto it = properties.find(lookup_key(name));
+   if (it == properties.end()) {
+      return nullptr;
+   }
+
+   // Values are modified only under the exclusive lock, by non-const callers
+   slot.value = const_cast<PropertyValue*>(&it->second);
+   slot.version = properties_version;
+   return slot.value;
+}
+
 void NodeImpl::do_remove_child(const std::string& name)
+{
+   delete_child(name);
+   update();
+}
+
+void NodeImpl::delete_child(const std::string& name)
 {
    auto it = nodes.find(name);
    if (it == nodes.end()) {
@@ -314,15 +825,15 @@ void NodeImpl::do_remove_child(const std::string& name)
 
    std::shared_ptr<NodeImpl> removing_node = it->second.node.lock();
    if (removing_node == nullptr) {
-      removing_node = std::make_shared<NodeImpl>(shared_from_this(), volume_impl, it->second.record_id);
+      removing_node = std::make_shared<NodeImpl>(shared_from_this(), volume_impl, it->second.node_id);
+      removing_node->path_hash = get_child_path_hash(path_hash, name);
    }
    removing_node->delete_from_volume();
+   removing_node->path_changed();
 
    node_id_t child_node_id = it->second.node_id;
    nodes.erase(it);
    child_names_by_ids.erase(child_node_id);
-
-   update();
 }
 
 void NodeImpl::save(bool create_new)
@@ -331,44 +842,66 @@ void NodeImpl::save(bool create_new)
       return;
    }
 
+   ScopedTimer timer(Histogram::node_save);
+   TraceScope trace(TraceEvent::node_save, node_id, record_id);
+   metrics::increment(Counter::node_saves);
+
    std::ostringstream os;
    serialize(os, nodes);
    serialize(os, properties);
    serialize(os, node_id);
    serialize(os, time_to_remove);
+   serialize(os, idle_time.load(std::memory_order_relaxed));
+   serialize(os, property_times_to_remove);
    std::string data = os.str();
+   trace.set_size(data.length());
 
+   record_id_t old_record_id = record_id;
    if (create_new) {
       record_id = volume_impl->get_volume_file()->allocate_record(data.c_str(), data.length());
    } else {
       record_id = volume_impl->get_volume_file()->resize_record(record_id, data.c_str(), data.length());
    }
 
-   if (!parent) {
-      volume_impl->get_volume_file()->set_root_node_record_id(record_id);
-   }
-}
+   serialized_size = data.length();
 
-void NodeImpl::save_nodes()
-{
-   if (record_id == DELETED_NODE_RECORD_ID) {
-      return;
+   if (create_new) {
+      TraceScope record_update_trace(TraceEvent::node_record_update, node_id, record_id);
+      volume_impl->get_node_records_table()->add_node(node_id, record_id, get_parent_node_id());
+   } else if (old_record_id != record_id) {
+      // Parents reference children by node id, so a moved record only changes the node records table
+      TraceScope record_update_trace(TraceEvent::node_record_update, node_id, record_id);
+      volume_impl->get_node_records_table()->set_node_record_id(node_id, record_id);
    }
+   trace.set_record_id(record_id);
 
-   std::ostringstream os;
-   serialize(os, nodes);
-   std::string data = os.str();
-   volume_impl->get_volume_file()->write_record(record_id, data.c_str(), data.length());
+   for (auto& blob_property : released_blobs) {
+      blob_property.remove(volume_impl->get_volume_file());
+   }
+   released_blobs.clear();
 }
 
 void NodeImpl::load()
 {
+   ScopedTimer timer(Histogram::node_load);
+   TraceScope trace(TraceEvent::node_load, node_id, record_id);
+   metrics::increment(Counter::node_loads);
+
+   node_id_t stored_node_id;
    volume_impl->get_volume_file()->read_record(record_id, [&](std::istream& is) {
+      std::streampos start = is.tellg();
       deserialize(is, nodes);
       deserialize(is, properties);
-      deserialize(is, node_id);
+      deserialize(is, stored_node_id);
       deserialize(is, time_to_remove);
+      int64_t stored_idle_time;
+      deserialize(is, stored_idle_time);
+      idle_time.store(stored_idle_time, std::memory_order_relaxed);
+      deserialize(is, property_times_to_remove);
+      serialized_size = static_cast<size_t>(is.tellg() - start);
    });
+   assert(stored_node_id == node_id);
+   trace.set_size(serialized_size);
 
    for (auto it = nodes.begin(); it != nodes.end(); ++it) {
       child_names_by_ids.insert({ it->second.node_id, it->first });
@@ -381,96 +914,188 @@ void NodeImpl::update()
       return;
    }
 
-   record_id_t old_record_id = record_id;
-   save(false);
-   if (old_record_id != record_id) {
-      if (parent) {
-         parent->child_node_record_id_updated(node_id, record_id);
-      } else {
-         volume_impl->get_volume_file()->set_root_node_record_id(record_id);
+   NodeFlusher* node_flusher = volume_impl->get_node_flusher();
+   if (node_flusher) {
+      // Write-back mode, the node is saved later by the flusher
+      if (!dirty) {
+         dirty = true;
+         node_flusher->node_changed(shared_from_this(), record_id, serialized_size);
       }
+      return;
    }
-}
 
-struct NodeToDelete {
-   std::shared_ptr<NodeImpl> node;
-   bool children_added;
+   save(false);
+}
 
-   NodeToDelete(std::shared_ptr<NodeImpl> node)
-      : node(node)
-      , children_added(false)
-   {
-      node->lock.lock();
+void NodeImpl::delete_from_volume()
+{
+   // Not using recursion due to possible large nodes depth, which could cause stack overflow
+   std::vector<std::shared_ptr<NodeImpl>> nodes_to_delete;
+   nodes_to_delete.push_back(shared_from_this());
+   while (nodes_to_delete.size() > 0) {
+      std::shared_ptr<NodeImpl> node = std::move(nodes_to_delete.back());
+      nodes_to_delete.pop_back();
+      node->delete_node(nodes_to_delete);
    }
+}
 
-   NodeToDelete(const NodeToDelete&) = delete;
-   NodeToDelete(NodeToDelete&&) = default;
-   void operator=(const NodeToDelete&) = delete;
+void NodeImpl::delete_node(std::vector<std::shared_ptr<NodeImpl>>& children)
+{
+   lock_guard locker(lock);
+   if (record_id == DELETED_NODE_RECORD_ID) {
+      return;
+   }
 
-   ~NodeToDelete() {
-      if (node) {
-         node->lock.unlock();
+   // Children are loaded before the node is marked deleted, they still have to reference the volume
+   for (auto it = nodes.begin(); it != nodes.end(); ++it) {
+      std::shared_ptr<NodeImpl> child = it->second.node.lock();
+      if (!child) {
+         child = std::make_shared<NodeImpl>(shared_from_this(), volume_impl, it->second.node_id);
+         child->path_hash = get_child_path_hash(path_hash, it->first);
       }
-   }   
-};
+      children.push_back(child);
+   }
 
-void NodeImpl::delete_from_volume()
+   volume_impl->get_volume_file()->delete_record(record_id);
+   volume_impl->get_node_records_table()->remove_node_record_id(node_id);
+   volume_impl->get_path_filter().remove(path_hash);
+   for (auto key_property : properties) {
+      std::visit(RemoveBlobPropertyVisitor(volume_impl->get_volume_file()), key_property.second);
+   }
+   for (auto& blob_property : released_blobs) {
+      blob_property.remove(volume_impl->get_volume_file());
+   }
+   released_blobs.clear();
+   if (idle_time.load(std::memory_order_relaxed) != 0) {
+      volume_impl->get_time_to_live_manager()->remove_sliding_node(node_id);
+   }
+   record_id = DELETED_NODE_RECORD_ID;
+   volume_impl = nullptr;
+}
+
+void NodeImpl::add_path_hashes(PathFilter& filter)
 {
-   // Not using recursion due to possible large nodes depth, which could cause stack overflow
+   struct NodeToVisit
+   {
+      std::shared_ptr<NodeImpl> parent;
+      node_id_t node_id;
+      std::shared_ptr<NodeImpl> node;
+      uint64_t path_hash;
+   };
+
+   filter.add(path_hash);
+
+   // Not loaded nodes are loaded only while they are visited
+   std::vector<NodeToVisit> nodes_to_visit;
+   nodes_to_visit.push_back({ nullptr, node_id, shared_from_this(), path_hash });
+   while (nodes_to_visit.size() > 0) {
+      NodeToVisit node_to_visit = std::move(nodes_to_visit.back());
+      nodes_to_visit.pop_back();
+
+      std::shared_ptr<NodeImpl> node = node_to_visit.node;
+      if (!node) {
+         // Loaded under the parent lock, so the child isn't deleted meanwhile
+         shared_lock parent_locker(node_to_visit.parent->lock);
+         if (node_to_visit.parent->child_names_by_ids.count(node_to_visit.node_id) == 0) {
+            continue;
+         }
+         node = std::make_shared<NodeImpl>(node_to_visit.parent, volume_impl, node_to_visit.node_id);
+      }
+
+      shared_lock locker(node->lock);
+      for (auto& child : node->nodes) {
+         uint64_t child_path_hash = get_child_path_hash(node_to_visit.path_hash, child.first);
+         filter.add(child_path_hash);
+         nodes_to_visit.push_back({ node, child.second.node_id, child.second.node.lock(), child_path_hash });
+      }
+   }
+}
 
-   std::vector<NodeToDelete> nodes_to_delete;
-   nodes_to_delete.push_back(NodeToDelete(shared_from_this()));
+void NodeImpl::update_path_hashes(const ChildNode& child, uint64_t old_path_hash, uint64_t new_path_hash)
+{
+   struct NodeToUpdate
+   {
+      std::shared_ptr<NodeImpl> parent;
+      node_id_t node_id;
+      std::shared_ptr<NodeImpl> node;
+      uint64_t old_path_hash;
+      uint64_t new_path_hash;
+   };
+
+   // Descendants of a not loaded node are not loaded too, so they are visited only to update the filter
+   PathFilter& filter = volume_impl->get_path_filter();
+   bool update_filter = filter.is_enabled();
+
+   std::vector<NodeToUpdate> nodes_to_update;
+   std::shared_ptr<NodeImpl> child_node = child.node.lock();
+   if (child_node || update_filter) {
+      nodes_to_update.push_back({ shared_from_this(), child.node_id, child_node, old_path_hash, new_path_hash });
+   }
 
-   while (nodes_to_delete.size() > 0) {
-      NodeToDelete& node_to_delete = nodes_to_delete.back();
+   while (nodes_to_update.size() > 0) {
+      NodeToUpdate node_to_update = std::move(nodes_to_update.back());
+      nodes_to_update.pop_back();
 
-      if (node_to_delete.node->record_id == DELETED_NODE_RECORD_ID) {
-         nodes_to_delete.pop_back();
-         continue;
+      std::shared_ptr<NodeImpl> node = node_to_update.node;
+      if (!node) {
+         node = std::make_shared<NodeImpl>(node_to_update.parent, volume_impl, node_to_update.node_id);
       }
 
-      if (!node_to_delete.children_added) {
-         node_to_delete.children_added = true;
-         std::shared_ptr<NodeImpl> node = node_to_delete.node;
-         for (auto it = node->nodes.begin(); it != node->nodes.end(); ++it) {
-            std::shared_ptr<NodeImpl> child = it->second.node.lock();
-            if (!child) {
-               child = std::make_shared<NodeImpl>(shared_from_this(), volume_impl, it->second.record_id);
-            }
-            nodes_to_delete.push_back(NodeToDelete(child));
+      filter.remove(node_to_update.old_path_hash);
+      filter.add(node_to_update.new_path_hash);
+
+      // Children added concurrently take the path hash of their parent under its lock
+      lock_guard locker(node->lock);
+      node->path_hash = node_to_update.new_path_hash;
+      for (auto& grandchild : node->nodes) {
+         std::shared_ptr<NodeImpl> grandchild_node = grandchild.second.node.lock();
+         if (grandchild_node || update_filter) {
+            nodes_to_update.push_back({ node, grandchild.second.node_id, grandchild_node,
+               get_child_path_hash(node_to_update.old_path_hash, grandchild.first),
+               get_child_path_hash(node_to_update.new_path_hash, grandchild.first) });
          }
-         continue;
-      }
-
-      volume_impl->get_volume_file()->delete_record(node_to_delete.node->record_id);
-      for (auto key_property : node_to_delete.node->properties) {
-         std::visit(RemoveBlobPropertyVisitor(volume_impl->get_volume_file()), key_property.second);
       }
-      node_to_delete.node->record_id = DELETED_NODE_RECORD_ID;
-      node_to_delete.node->volume_impl = nullptr;
-
-      nodes_to_delete.pop_back();
    }
 }
 
-template bool NodeImpl::get_property_impl<int>(const std::string& name, int& value) const;
-template bool NodeImpl::get_property_impl<unsigned>(const std::string& name, unsigned& value) const;
-template bool NodeImpl::get_property_impl<int64_t>(const std::string& name, int64_t& value) const;
-template bool NodeImpl::get_property_impl<uint64_t>(const std::string& name, uint64_t& value) const;
-template bool NodeImpl::get_property_impl<float>(const std::string& name, float& value) const;
-template bool NodeImpl::get_property_impl<double>(const std::string& name, double& value) const;
-template bool NodeImpl::get_property_impl<long double>(const std::string& name, long double& value) const;
-template bool NodeImpl::get_property_impl<std::string>(const std::string& name, std::string& value) const;
-template bool NodeImpl::get_property_impl<std::vector<char>>(const std::string& name, std::vector<char>& value) const;
-
-template void NodeImpl::set_property_impl<int>(const std::string& name, const int& value);
-template void NodeImpl::set_property_impl<unsigned>(const std::string& name, const unsigned& value);
-template void NodeImpl::set_property_impl<int64_t>(const std::string& name, const int64_t& value);
-template void NodeImpl::set_property_impl<uint64_t>(const std::string& name, const uint64_t& value);
-template void NodeImpl::set_property_impl<float>(const std::string& name, const float& value);
-template void NodeImpl::set_property_impl<double>(const std::string& name, const double& value);
-template void NodeImpl::set_property_impl<long double>(const std::string& name, const long double& value);
-template void NodeImpl::set_property_impl<std::string>(const std::string& name, const std::string& value);
-template void NodeImpl::set_property_impl<BlobHolder>(const std::string& name, const BlobHolder& value);
+template bool NodeImpl::get_property_impl<int>(std::string_view name, int& value) const;
+template bool NodeImpl::get_property_impl<unsigned>(std::string_view name, unsigned& value) const;
+template bool NodeImpl::get_property_impl<int64_t>(std::string_view name, int64_t& value) const;
+template bool NodeImpl::get_property_impl<uint64_t>(std::string_view name, uint64_t& value) const;
+template bool NodeImpl::get_property_impl<float>(std::string_view name, float& value) const;
+template bool NodeImpl::get_property_impl<double>(std::string_view name, double& value) const;
+template bool NodeImpl::get_property_impl<long double>(std::string_view name, long double& value) const;
+template bool NodeImpl::get_property_impl<std::string>(std::string_view name, std::string& value) const;
+template bool NodeImpl::get_property_impl<std::vector<char>>(std::string_view name, std::vector<char>& value) const;
+
+template bool NodeImpl::get_property_impl<int>(NodeImpl::PropertySlot& slot, std::string_view name, int& value) const;
+template bool NodeImpl::get_property_impl<unsigned>(NodeImpl::PropertySlot& slot, std::string_view name, unsigned& value) const;
+template bool NodeImpl::get_property_impl<int64_t>(NodeImpl::PropertySlot& slot, std::string_view name, int64_t& value) const;
+template bool NodeImpl::get_property_impl<uint64_t>(NodeImpl::PropertySlot& slot, std::string_view name, uint64_t& value) const;
+template bool NodeImpl::get_property_impl<float>(NodeImpl::PropertySlot& slot, std::string_view name, float& value) const;
+template bool NodeImpl::get_property_impl<double>(NodeImpl::PropertySlot& slot, std::string_view name, double& value) const;
+template bool NodeImpl::get_property_impl<long double>(NodeImpl::PropertySlot& slot, std::string_view name, long double& value) const;
+template bool NodeImpl::get_property_impl<std::string>(NodeImpl::PropertySlot& slot, std::string_view name, std::string& value) const;
+template bool NodeImpl::get_property_impl<std::vector<char>>(NodeImpl::PropertySlot& slot, std::string_view name, std::vector<char>& value) const;
+
+template void NodeImpl::set_property_impl<int>(std::string_view name, const int& value);
+template void NodeImpl::set_property_impl<unsigned>(std::string_view name, const unsigned& value);
+template void NodeImpl::set_property_impl<int64_t>(std::string_view name, const int64_t& value);
+template void NodeImpl::set_property_impl<uint64_t>(std::string_view name, const uint64_t& value);
+template void NodeImpl::set_property_impl<float>(std::string_view name, const float& value);
+template void NodeImpl::set_property_impl<double>(std::string_view name, const double& value);
+template void NodeImpl::set_property_impl<long double>(std::string_view name, const long double& value);
+template void NodeImpl::set_property_impl<std::string>(std::string_view name, const std::string& value);
+template void NodeImpl::set_property_impl<BlobHolder>(std::string_view name, const BlobHolder& value);
+
+template void NodeImpl::set_property_impl<int>(NodeImpl::PropertySlot& slot, std::string_view name, const int& value);
+template void NodeImpl::set_property_impl<unsigned>(NodeImpl::PropertySlot& slot, std::string_view name, const unsigned& value);
+template void NodeImpl::set_property_impl<int64_t>(NodeImpl::PropertySlot& slot, std::string_view name, const int64_t& value);
+template void NodeImpl::set_property_impl<uint64_t>(NodeImpl::PropertySlot& slot, std::string_view name, const uint64_t& value);
+template void NodeImpl::set_property_impl<float>(NodeImpl::PropertySlot& slot, std::string_view name, const float& value);
+template void NodeImpl::set_property_impl<double>(NodeImpl::PropertySlot& slot, std::string_view name, const double& value);
+template void NodeImpl::set_property_impl<long double>(NodeImpl::PropertySlot& slot, std::string_view name, const long double& value);
+template void NodeImpl::set_property_impl<std::string>(NodeImpl::PropertySlot& slot, std::string_view name, const std::string& value);
+template void NodeImpl::set_property_impl<BlobHolder>(NodeImpl::PropertySlot& slot, std::string_view name, const BlobHolder& value);
 
 }
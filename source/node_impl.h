@@ -4,15 +4,23 @@
 #include <vector>
 #include <unordered_map>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <chrono>
+#include <atomic>
 
 #include <node.h>
+#include <batch.h>
 
 #include "volume_impl.h"
 #include "blob_property.h"
+#include "path_filter.h"
+#include "utility.h"
+#include "metrics_registry.h"
+#include "subtree_remover.h"
 
 namespace hks {
 
@@ -20,16 +28,38 @@ class NodeImpl : public Node, public std::enable_shared_from_this<NodeImpl>
 {
 public:
    using PropertyValue = std::variant<int, unsigned, int64_t, uint64_t, float, double, long double, std::string, BlobProperty>;
+   using timepoint = std::chrono::time_point<std::chrono::system_clock>;
+
+   struct PropertyChange
+   {
+      std::string name;
+      // Null if property is removed
+      const Batch::Value* value;
+   };
+
+   struct PropertyRead
+   {
+      std::string_view name;
+      std::optional<Value>* value;
+   };
+
+   // Location of a property in the node, valid until any property of the node is removed
+   struct PropertySlot
+   {
+      PropertyValue* value = nullptr;
+      uint64_t version = 0;
+   };
 
    // New node
    NodeImpl(std::shared_ptr<NodeImpl> parent, VolumeImpl* volume_impl);
 
    // Existing node
-   NodeImpl(std::shared_ptr<NodeImpl> parent, VolumeImpl* volume_impl, record_id_t record_id);
+   NodeImpl(std::shared_ptr<NodeImpl> parent, VolumeImpl* volume_impl, node_id_t node_id);
 
-   std::shared_ptr<NodeImpl> get_child_impl(const std::string& name);
+   std::shared_ptr<NodeImpl> get_child_impl(std::string_view name);
    std::shared_ptr<NodeImpl> add_child_impl(const std::string& name);
-   std::shared_ptr<NodeImpl> get_node_impl(const std::string& path);
+   void add_children_impl(const std::vector<std::string>& names);
+   std::shared_ptr<NodeImpl> get_node_impl(std::string_view path);
    void rename_child_impl(const std::string& name, const std::string& new_name);
    void remove_child_impl(const std::string& name);
 
@@ -38,21 +68,57 @@ public:
    node_id_t get_node_id() const;
    std::shared_ptr<NodeImpl> get_child_impl(node_id_t node_id);
    bool remove_child_impl(node_id_t node_id);
-
-   template<typename T> void set_property_impl(const std::string& name, const T& value);
-   template<typename T> bool get_property_impl(const std::string& name, T& value) const;
-   bool remove_property_impl(const std::string& name);
+   // Removes children, which have expired at now, with one node update. Their subtrees are deleted by the remover.
+   // Returns the number of removed children
+   size_t remove_children_impl(const std::vector<node_id_t>& node_ids, timepoint now, SubtreeRemover& subtree_remover);
+
+   template<typename T> void set_property_impl(std::string_view name, const T& value);
+   template<typename T> bool get_property_impl(std::string_view name, T& value) const;
+   template<typename T> void set_property_impl(PropertySlot& slot, std::string_view name, const T& value);
+   template<typename T> bool get_property_impl(PropertySlot& slot, std::string_view name, T& value) const;
+   bool remove_property_impl(std::string_view name);
+   // Returns false if the property doesn't exist
+   bool set_property_time_to_live_impl(std::string_view name, std::chrono::milliseconds time);
+   // Removes properties, which have expired at now, with one node update. Returns the number of removed properties
+   size_t remove_expired_properties(const std::vector<uint64_t>& property_hashes, timepoint now);
+   void apply_property_changes(const std::vector<PropertyChange>& changes);
+   void get_property_values(const std::vector<PropertyRead>& reads) const;
+
+   void apply_impl(const Batch& batch);
+
+   // Adds path hashes of the subtree to the filter
+   void add_path_hashes(PathFilter& filter);
 
    void set_time_to_live(std::chrono::milliseconds time);
+   void set_sliding_time_to_live(std::chrono::milliseconds time);
+   void set_children_time_to_live_impl(std::chrono::milliseconds time);
+   void set_children_time_to_live_impl(const std::vector<std::pair<std::string, std::chrono::milliseconds>>& times);
+   // Extends sliding time to live
+   void touch();
+   // Extends the time to remove by the last access and schedules the node again, if it's after now.
+   // Returns false if the node has expired. Now is timepoint() if no key of the node has expired, the key is replaced then
+   bool reschedule_time_to_remove(timepoint now);
+   // Time to remove has passed, but the node may be not removed yet
+   bool is_expired() const;
+   // Checks the node and its ancestors, which are skipped by lookups of cached paths
+   bool is_path_expired() const;
+   // Called after the node is renamed or removed from its parent, invalidates cached paths of its subtree
+   void path_changed();
+   // Version has to be taken before the path is resolved. Checks the node and its ancestors
+   static uint64_t get_paths_version();
+   bool is_path_changed(uint64_t paths_version) const;
+
+   // Writes node to the volume file, if it was changed in write-back mode
+   void flush();
 
 private:
-   using mutex = std::mutex;
+   // Reads take the lock shared, so readers of hot nodes like the root don't serialize
+   using mutex = MeteredSharedMutex;
    using lock_guard = std::lock_guard<mutex>;
-   using timepoint = std::chrono::time_point<std::chrono::system_clock>;
+   using shared_lock = std::shared_lock<mutex>;
 
    struct ChildNode
    {
-      record_id_t record_id;
       node_id_t node_id;
       mutable std::weak_ptr<NodeImpl> node;
 
@@ -60,48 +126,88 @@ private:
       void deserialize(std::istream& os);
    };
 
-   friend struct NodeToDelete;
+   friend class NodeCache;
+   friend class SubtreeRemover;
+   friend class VolumeImpl;
 
    static const uint64_t DELETED_NODE_RECORD_ID = record_id_t(-1);
 
    void save(bool create_new);
-   void save_nodes();
    void load();
    void update();
 
-   void delete_from_volume();
-
-   void child_node_record_id_updated(node_id_t child_node_id, record_id_t new_record_id);
-
-   std::vector<node_id_t> get_unique_node_path();
+   void set_time_to_remove(timepoint time, std::chrono::milliseconds idle_time);
+   // Sets times of children, which are scheduled with one call of the time to live manager
+   void do_set_children_time_to_live(const std::vector<std::pair<std::string, std::chrono::milliseconds>>& times);
+   // Sets the time without scheduling it, returns the previous time
+   timepoint replace_time_to_remove(timepoint time);
 
-   std::shared_ptr<NodeImpl> do_get_child(const std::string& name);
+   void delete_from_volume();
+   // Deletes the node from the volume file, its children are appended to be deleted next
+   void delete_node(std::vector<std::shared_ptr<NodeImpl>>& children);
+   void update_path_hashes(const ChildNode& child, uint64_t old_path_hash, uint64_t new_path_hash);
+
+   node_id_t get_parent_node_id() const;
+
+   // Finds child including expired one
+   std::shared_ptr<NodeImpl> find_child(std::string_view name);
+   std::shared_ptr<NodeImpl> find_loaded_child(std::string_view name, bool& exists) const;
+   std::shared_ptr<NodeImpl> do_get_child(std::string_view name);
+   std::shared_ptr<NodeImpl> do_add_child(const std::string& name);
+   // Removes the child if it has expired, so its name can be taken. Returns true if the child exists after that
+   bool has_child(const std::string& name);
+   void do_set_property(std::string_view name, const PropertyValue& value);
+   void do_set_property(PropertySlot& slot, std::string_view name, const PropertyValue& value);
+   bool do_remove_property(std::string_view name);
+   PropertyValue* find_property(PropertySlot& slot, std::string_view name) const;
+   // Expired properties are absent for reads and writes before the time to live manager removes them
+   bool is_property_expired(std::string_view name) const;
+   template<typename T> bool convert_property(const PropertyValue& property_value, T& value) const;
    void do_remove_child(const std::string& name);
+   // Deletes child from the volume without updating the node
+   void delete_child(const std::string& name);
 
    mutable mutex lock;
 
    record_id_t record_id;
    node_id_t node_id;
    timepoint time_to_remove;
+   // Sliding time to live in milliseconds, 0 if it's not set. Last access is kept by the time to live manager
+   std::atomic<int64_t> idle_time{ 0 };
+   // Times to remove properties, a property keeps its time when it's set again before it expires
+   std::unordered_map<std::string, timepoint> property_times_to_remove;
+   size_t serialized_size = 0;
+   // Hash of the node path inside the volume
+   uint64_t path_hash = ROOT_PATH_HASH;
+   bool dirty = false;
+   // Set on access, cleared by the node cache
+   std::atomic<bool> recently_used = false;
 
    std::unordered_map<std::string, ChildNode> nodes;
    std::unordered_map<std::string, PropertyValue> properties;
+   // Incremented when a property is removed, invalidates property slots
+   uint64_t properties_version = 0;
    std::unordered_map<node_id_t, std::string> child_names_by_ids;
 
+   // Blobs of replaced and removed properties, their records are deleted after the node is saved
+   std::vector<BlobProperty> released_blobs;
+
    std::shared_ptr<NodeImpl> parent;
+   // Version of paths when the node was renamed or removed, 0 if it wasn't
+   std::atomic<uint64_t> path_version{ 0 };
+   // Process-wide, so it orders changes of nodes of all volumes and storages
+   static std::atomic<uint64_t> paths_version;
    VolumeImpl* volume_impl;
 };
 
 
 inline void NodeImpl::ChildNode::serialize(std::ostream& os) const
 {
-   hks::serialize(os, record_id);
    hks::serialize(os, node_id);
 }
 
 inline void NodeImpl::ChildNode::deserialize(std::istream& is)
 {
-   hks::deserialize(is, record_id);
    hks::deserialize(is, node_id);
 }
 
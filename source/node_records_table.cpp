@@ -0,0 +1,147 @@
+#include <sstream>
+#include <cstddef>
+
+#include "node_records_table.h"
+#include "serialization.h"
+
+namespace hks {
+
+NodeRecordsTable::NodeRecordsTable(std::shared_ptr<VolumeFile> volume_file)
+   : volume_file(volume_file)
+   , record_id(EMPTY_RECORD_ID)
+{
+   save_directory();
+}
+
+NodeRecordsTable::NodeRecordsTable(std::shared_ptr<VolumeFile> volume_file, record_id_t record_id)
+   : volume_file(volume_file)
+   , record_id(record_id)
+{
+   volume_file->read_record(record_id, [&](std::istream& is) {
+      deserialize(is, page_record_ids);
+   });
+   pages.resize(page_record_ids.size());
+}
+
+record_id_t NodeRecordsTable::get_node_record_id(node_id_t node_id)
+{
+   lock_guard locker(lock);
+   Slot* slot = find_slot(node_id);
+   return slot ? slot->record_id : EMPTY_RECORD_ID;
+}
+
+node_id_t NodeRecordsTable::get_parent_node_id(node_id_t node_id)
+{
+   lock_guard locker(lock);
+   Slot* slot = find_slot(node_id);
+   return slot ? slot->parent_node_id : NO_NODE_ID;
+}
+
+void NodeRecordsTable::add_node(node_id_t node_id, record_id_t node_record_id, node_id_t parent_node_id)
+{
+   lock_guard locker(lock);
+   write_slot(node_id, Slot{ node_record_id, parent_node_id });
+}
+
+void NodeRecordsTable::set_node_record_id(node_id_t node_id, record_id_t node_record_id)
+{
+   lock_guard locker(lock);
+
+   size_t i_page = static_cast<size_t>(node_id / PAGE_RECORDS_COUNT);
+   size_t i_slot = static_cast<size_t>(node_id % PAGE_RECORDS_COUNT);
+
+   Page& page = get_page(i_page);
+   page[i_slot].record_id = node_record_id;
+   volume_file->write_record(page_record_ids[i_page], i_slot * sizeof(Slot) + offsetof(Slot, record_id), &node_record_id, sizeof(record_id_t));
+}
+
+void NodeRecordsTable::remove_node_record_id(node_id_t node_id)
+{
+   lock_guard locker(lock);
+   write_slot(node_id, Slot{ EMPTY_RECORD_ID, NO_NODE_ID });
+}
+
+std::vector<node_id_t> NodeRecordsTable::get_orphan_node_ids(node_id_t root_node_id)
+{
+   lock_guard locker(lock);
+   std::vector<node_id_t> node_ids;
+   for (size_t i_page = 0; i_page < page_record_ids.size(); i_page++) {
+      Page& page = get_page(i_page);
+      for (size_t i_slot = 0; i_slot < PAGE_RECORDS_COUNT; i_slot++) {
+         node_id_t node_id = node_id_t(i_page * PAGE_RECORDS_COUNT + i_slot);
+         if (page[i_slot].record_id == EMPTY_RECORD_ID || node_id == root_node_id) {
+            continue;
+         }
+
+         // Node ids aren't reused, so a removed parent slot means the parent is deleted
+         Slot* parent_slot = page[i_slot].parent_node_id == NO_NODE_ID ? nullptr : find_slot(page[i_slot].parent_node_id);
+         if (parent_slot == nullptr || parent_slot->record_id == EMPTY_RECORD_ID) {
+            node_ids.push_back(node_id);
+         }
+      }
+   }
+   return node_ids;
+}
+
+NodeRecordsTable::Slot* NodeRecordsTable::find_slot(node_id_t node_id)
+{
+   size_t i_page = static_cast<size_t>(node_id / PAGE_RECORDS_COUNT);
+   if (i_page >= page_record_ids.size()) {
+      return nullptr;
+   }
+   return &get_page(i_page)[node_id % PAGE_RECORDS_COUNT];
+}
+
+void NodeRecordsTable::write_slot(node_id_t node_id, const Slot& slot)
+{
+   size_t i_page = static_cast<size_t>(node_id / PAGE_RECORDS_COUNT);
+   size_t i_slot = static_cast<size_t>(node_id % PAGE_RECORDS_COUNT);
+
+   Page& page = get_page(i_page);
+   page[i_slot] = slot;
+   volume_file->write_record(page_record_ids[i_page], i_slot * sizeof(Slot), &slot, sizeof(Slot));
+}
+
+NodeRecordsTable::Page& NodeRecordsTable::get_page(size_t i_page)
+{
+   if (i_page >= page_record_ids.size()) {
+      // Node ids are allocated sequentially, so usually only one page is added
+      while (page_record_ids.size() <= i_page) {
+         std::unique_ptr<Page> page = std::make_unique<Page>();
+         page->fill(Slot{ EMPTY_RECORD_ID, NO_NODE_ID });
+         page_record_ids.push_back(volume_file->allocate_record(page->data(), sizeof(Page)));
+         pages.push_back(std::move(page));
+      }
+      save_directory();
+   }
+
+   if (!pages[i_page]) {
+      std::unique_ptr<Page> page = std::make_unique<Page>();
+      volume_file->read_record(page_record_ids[i_page], [&](std::istream& is) {
+         is.read(reinterpret_cast<char*>(page->data()), sizeof(Page));
+      });
+      pages[i_page] = std::move(page);
+   }
+
+   return *pages[i_page];
+}
+
+void NodeRecordsTable::save_directory()
+{
+   std::ostringstream os;
+   serialize(os, page_record_ids);
+   std::string data = os.str();
+
+   record_id_t old_record_id = record_id;
+   if (record_id == EMPTY_RECORD_ID) {
+      record_id = volume_file->allocate_record(data.c_str(), data.length());
+   } else {
+      record_id = volume_file->resize_record(record_id, data.c_str(), data.length());
+   }
+
+   if (old_record_id != record_id) {
+      volume_file->set_node_records_table_record_id(record_id);
+   }
+}
+
+}
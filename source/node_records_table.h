@@ -0,0 +1,73 @@
+#ifndef HKEYSTORE_NODE_RECORDS_TABLE_H
+#define HKEYSTORE_NODE_RECORDS_TABLE_H
+
+#include <memory>
+#include <array>
+#include <vector>
+#include <mutex>
+
+#include "volume_file.h"
+
+namespace hks {
+
+// Persistent mapping from node ids to record ids and parent ids of nodes
+//
+// Node ids are allocated sequentially, so the table is a directory of fixed-size pages,
+// each page holding slots for a contiguous range of node ids.
+// Parents reference children by node id only, so when a node record is moved
+// only one slot of the table is rewritten. Nodes keep their parents, they are renamed only within them,
+// so a node is found by its id through the parent ids without loading any node
+
+class NodeRecordsTable
+{
+public:
+   static const node_id_t NO_NODE_ID = node_id_t(-1);
+
+   // New table
+   explicit NodeRecordsTable(std::shared_ptr<VolumeFile> volume_file);
+
+   // Existing table
+   NodeRecordsTable(std::shared_ptr<VolumeFile> volume_file, record_id_t record_id);
+
+   NodeRecordsTable(const NodeRecordsTable&) = delete;
+   void operator=(const NodeRecordsTable&) = delete;
+
+   record_id_t get_node_record_id(node_id_t node_id);
+   // NO_NODE_ID for the root and removed nodes
+   node_id_t get_parent_node_id(node_id_t node_id);
+   void add_node(node_id_t node_id, record_id_t node_record_id, node_id_t parent_node_id);
+   void set_node_record_id(node_id_t node_id, record_id_t node_record_id);
+   void remove_node_record_id(node_id_t node_id);
+   // Nodes, whose parents are deleted. They are left if the process stops while a subtree is deleted.
+   // Reads all pages of the table
+   std::vector<node_id_t> get_orphan_node_ids(node_id_t root_node_id);
+
+private:
+   static const size_t PAGE_RECORDS_COUNT = 512;
+   static const record_id_t EMPTY_RECORD_ID = record_id_t(-1);
+
+   struct Slot
+   {
+      record_id_t record_id;
+      node_id_t parent_node_id;
+   };
+
+   using Page = std::array<Slot, PAGE_RECORDS_COUNT>;
+   using lock_guard = std::lock_guard<std::mutex>;
+
+   // Returns nullptr if the node id is after the last page
+   Slot* find_slot(node_id_t node_id);
+   void write_slot(node_id_t node_id, const Slot& slot);
+   Page& get_page(size_t i_page);
+   void save_directory();
+
+   std::mutex lock;
+   std::shared_ptr<VolumeFile> volume_file;
+   record_id_t record_id;
+   std::vector<record_id_t> page_record_ids;
+   std::vector<std::unique_ptr<Page>> pages;
+};
+
+}
+
+#endif
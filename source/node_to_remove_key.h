@@ -3,20 +3,49 @@
 
 #include <chrono>
 #include <iostream>
+#include <functional>
 #include "volume_file.h"
 #include "serialization.h"
 
 namespace hks {
 
+// Node or its property, which is removed when its time to live expires
+struct removal_target_t
+{
+   node_id_t node_id = 0;
+   // Hash of the property name, 0 if the node is removed
+   uint64_t property_hash = 0;
+
+   bool operator == (const removal_target_t& rhs) const
+   {
+      return node_id == rhs.node_id && property_hash == rhs.property_hash;
+   }
+};
+
+struct removal_target_hash_t
+{
+   size_t operator()(const removal_target_t& target) const
+   {
+      return std::hash<node_id_t>()(target.node_id) ^ std::hash<uint64_t>()(target.property_hash);
+   }
+};
+
+// Keys have fixed size, nodes are found by their ids
+
 struct node_to_remove_key_t
 {
    using timepoint = std::chrono::time_point<std::chrono::system_clock>;
 
    node_to_remove_key_t();
    node_to_remove_key_t(timepoint time, node_id_t node_id);
+   node_to_remove_key_t(timepoint time, const removal_target_t& target);
 
    timepoint time;
    node_id_t node_id;
+   // Hash of the property name, 0 if the node is removed
+   uint64_t property_hash;
+
+   removal_target_t get_target() const { return { node_id, property_hash }; }
 
    bool operator < (const node_to_remove_key_t& rhs) const;
 
@@ -24,24 +53,35 @@ struct node_to_remove_key_t
    {
       hks::serialize(os, time);
       hks::serialize(os, node_id);
+      hks::serialize(os, property_hash);
    }
 
    void deserialize(std::istream& is)
    {
       hks::deserialize(is, time);
       hks::deserialize(is, node_id);
+      hks::deserialize(is, property_hash);
    }
 };
 
 inline node_to_remove_key_t::node_to_remove_key_t()
    : time()
    , node_id(0)
+   , property_hash(0)
 {
 }
 
 inline node_to_remove_key_t::node_to_remove_key_t(timepoint time, node_id_t node_id)
    : time(time)
    , node_id(node_id)
+   , property_hash(0)
+{
+}
+
+inline node_to_remove_key_t::node_to_remove_key_t(timepoint time, const removal_target_t& target)
+   : time(time)
+   , node_id(target.node_id)
+   , property_hash(target.property_hash)
 {
 }
 
@@ -53,7 +93,10 @@ inline bool node_to_remove_key_t::operator < (const node_to_remove_key_t& rhs) c
    if (time > rhs.time) {
       return false;
    }
-   return node_id < rhs.node_id;
+   if (node_id != rhs.node_id) {
+      return node_id < rhs.node_id;
+   }
+   return property_hash < rhs.property_hash;
 }
 
 }
@@ -0,0 +1,97 @@
+#include <algorithm>
+
+#include "path_cache.h"
+#include "node_impl.h"
+#include "utility.h"
+
+namespace hks {
+
+PathCache::PathCache(size_t capacity)
+   : shard_capacity(std::max<size_t>(capacity / SHARDS_COUNT, 1))
+{
+}
+
+uint64_t PathCache::get_generation() const
+{
+   return generation.load(std::memory_order_acquire);
+}
+
+std::shared_ptr<NodeImpl> PathCache::find(std::string_view path) const
+{
+   uint64_t current_generation = get_generation();
+   const Shard& shard = get_shard(path);
+
+   std::shared_ptr<NodeImpl> node;
+   uint64_t paths_version;
+   {
+      std::shared_lock<std::shared_mutex> locker(shard.lock);
+      auto it = shard.entries.find(lookup_key(path));
+      if (it == shard.entries.end() || it->second.generation != current_generation) {
+         return nullptr;
+      }
+      node = it->second.node;
+      paths_version = it->second.paths_version;
+   }
+
+   // The node or one of its ancestors was renamed or removed after the path was resolved
+   if (node->is_path_changed(paths_version) || node->is_deleted_impl()) {
+      return nullptr;
+   }
+   return node;
+}
+
+void PathCache::insert(std::string_view path, std::shared_ptr<NodeImpl> node, uint64_t generation, uint64_t paths_version)
+{
+   uint64_t current_generation = get_generation();
+   if (generation != current_generation || node->is_path_changed(paths_version)) {
+      // Path was resolved before the cache was invalidated or some node on the path was renamed or removed
+      return;
+   }
+
+   Shard& shard = get_shard(path);
+   std::unique_lock<std::shared_mutex> locker(shard.lock);
+   if (shard.entries.size() >= shard_capacity && shard.entries.find(lookup_key(path)) == shard.entries.end()) {
+      // Drop stale entries first, start over if all of them are valid
+      for (auto it = shard.entries.begin(); it != shard.entries.end(); ) {
+         if (it->second.generation != current_generation) {
+            it = shard.entries.erase(it);
+         } else {
+            ++it;
+         }
+      }
+      if (shard.entries.size() >= shard_capacity) {
+         shard.entries.clear();
+      }
+   }
+
+   Entry& entry = shard.entries[std::string(path)];
+   entry.node = std::move(node);
+   entry.generation = generation;
+   entry.paths_version = paths_version;
+}
+
+void PathCache::invalidate()
+{
+   generation.fetch_add(1, std::memory_order_acq_rel);
+}
+
+void PathCache::clear()
+{
+   invalidate();
+   for (auto& shard : shards) {
+      std::unique_lock<std::shared_mutex> locker(shard.lock);
+      shard.entries.clear();
+   }
+}
+
+const PathCache::Shard& PathCache::get_shard(std::string_view path) const
+{
+   return shards[std::hash<std::string_view>()(path) % SHARDS_COUNT];
+}
+
+PathCache::Shard& PathCache::get_shard(std::string_view path)
+{
+   return shards[std::hash<std::string_view>()(path) % SHARDS_COUNT];
+}
+
+}
@@ -0,0 +1,68 @@
+#ifndef HKEYSTORE_PATH_CACHE_H
+#define HKEYSTORE_PATH_CACHE_H
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <array>
+#include <atomic>
+#include <shared_mutex>
+#include <unordered_map>
+
+namespace hks {
+
+class NodeImpl;
+
+// Cache of resolved storage paths
+//
+// Maps full node paths to nodes. Every entry remembers the paths version it was resolved at, a renamed or removed
+// node keeps the version of its change, so entries of its subtree become invalid and other entries stay. Entries
+// also remember the generation of the cache, which is bumped when all of them have to be invalidated.
+// Entries are dropped lazily when a shard runs out of space
+
+class PathCache
+{
+public:
+   explicit PathCache(size_t capacity);
+
+   PathCache(const PathCache&) = delete;
+   void operator=(const PathCache&) = delete;
+
+   // Generation and paths version have to be taken before the path is resolved
+   uint64_t get_generation() const;
+
+   std::shared_ptr<NodeImpl> find(std::string_view path) const;
+   void insert(std::string_view path, std::shared_ptr<NodeImpl> node, uint64_t generation, uint64_t paths_version);
+
+   // Invalidates all entries
+   void invalidate();
+   // Invalidates and releases all entries
+   void clear();
+
+private:
+   static const size_t SHARDS_COUNT = 16;
+
+   struct Entry
+   {
+      std::shared_ptr<NodeImpl> node;
+      uint64_t generation;
+      uint64_t paths_version;
+   };
+
+   struct Shard
+   {
+      mutable std::shared_mutex lock;
+      std::unordered_map<std::string, Entry> entries;
+   };
+
+   const Shard& get_shard(std::string_view path) const;
+   Shard& get_shard(std::string_view path);
+
+   std::atomic<uint64_t> generation = 0;
+   size_t shard_capacity;
+   std::array<Shard, SHARDS_COUNT> shards;
+};
+
+}
+
+#endif
@@ -0,0 +1,58 @@
+#include <mutex>
+
+#include "path_filter.h"
+
+namespace hks {
+
+void PathFilter::add(uint64_t path_hash)
+{
+   if (!enabled) {
+      return;
+   }
+
+   Shard& shard = shards[path_hash % SHARDS_COUNT];
+   std::unique_lock<std::shared_mutex> locker(shard.lock);
+   ++shard.counts[path_hash];
+}
+
+void PathFilter::remove(uint64_t path_hash)
+{
+   if (!enabled) {
+      return;
+   }
+
+   Shard& shard = shards[path_hash % SHARDS_COUNT];
+   std::unique_lock<std::shared_mutex> locker(shard.lock);
+   auto it = shard.counts.find(path_hash);
+   if (it != shard.counts.end() && --it->second == 0) {
+      shard.counts.erase(it);
+   }
+}
+
+bool PathFilter::might_contain(uint64_t path_hash) const
+{
+   if (!ready) {
+      return true;
+   }
+
+   const Shard& shard = shards[path_hash % SHARDS_COUNT];
+   std::shared_lock<std::shared_mutex> locker(shard.lock);
+   return shard.counts.find(path_hash) != shard.counts.end();
+}
+
+bool PathFilter::is_enabled() const
+{
+   return enabled;
+}
+
+bool PathFilter::enable()
+{
+   return !enabled.exchange(true);
+}
+
+void PathFilter::set_ready()
+{
+   ready = true;
+}
+
+}
@@ -0,0 +1,51 @@
+#ifndef HKEYSTORE_PATH_FILTER_H
+#define HKEYSTORE_PATH_FILTER_H
+
+#include <array>
+#include <atomic>
+#include <shared_mutex>
+#include <unordered_map>
+
+namespace hks {
+
+// Set of path hashes of all nodes in a volume
+//
+// Used when volumes are mounted one over another: a lookup skips volumes, which can't have the path,
+// without loading their nodes. Hashes are counted, so a path is kept while another path has the same hash.
+// Filter is enabled before it's filled, so changes made while the volume is walked are not lost.
+// Until it's ready every path is reported as possible
+
+class PathFilter
+{
+public:
+   PathFilter() = default;
+
+   PathFilter(const PathFilter&) = delete;
+   void operator=(const PathFilter&) = delete;
+
+   void add(uint64_t path_hash);
+   void remove(uint64_t path_hash);
+   bool might_contain(uint64_t path_hash) const;
+
+   bool is_enabled() const;
+   // Returns false if the filter was enabled before
+   bool enable();
+   void set_ready();
+
+private:
+   static const size_t SHARDS_COUNT = 16;
+
+   struct Shard
+   {
+      mutable std::shared_mutex lock;
+      std::unordered_map<uint64_t, uint32_t> counts;
+   };
+
+   std::atomic<bool> enabled = false;
+   std::atomic<bool> ready = false;
+   std::array<Shard, SHARDS_COUNT> shards;
+};
+
+}
+
+#endif
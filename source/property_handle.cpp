@@ -0,0 +1,168 @@
+#include <property_handle.h>
+#include "property_handle_impl.h"
+
+namespace hks {
+
+bool PropertyHandle::get(int& value) const
+{
+   return static_cast<const PropertyHandleImpl*>(this)->get_impl(value);
+}
+
+bool PropertyHandle::get(int64_t& value) const
+{
+   return static_cast<const PropertyHandleImpl*>(this)->get_impl(value);
+}
+
+bool PropertyHandle::get(unsigned& value) const
+{
+   return static_cast<const PropertyHandleImpl*>(this)->get_impl(value);
+}
+
+bool PropertyHandle::get(uint64_t& value) const
+{
+   return static_cast<const PropertyHandleImpl*>(this)->get_impl(value);
+}
+
+bool PropertyHandle::get(float& value) const
+{
+   return static_cast<const PropertyHandleImpl*>(this)->get_impl(value);
+}
+
+bool PropertyHandle::get(double& value) const
+{
+   return static_cast<const PropertyHandleImpl*>(this)->get_impl(value);
+}
+
+bool PropertyHandle::get(long double& value) const
+{
+   return static_cast<const PropertyHandleImpl*>(this)->get_impl(value);
+}
+
+bool PropertyHandle::get(std::string& value) const
+{
+   return static_cast<const PropertyHandleImpl*>(this)->get_impl(value);
+}
+
+bool PropertyHandle::get(std::vector<char>& value) const
+{
+   return static_cast<const PropertyHandleImpl*>(this)->get_impl(value);
+}
+
+bool PropertyHandle::set(int value)
+{
+   return static_cast<PropertyHandleImpl*>(this)->set_impl(value);
+}
+
+bool PropertyHandle::set(int64_t value)
+{
+   return static_cast<PropertyHandleImpl*>(this)->set_impl(value);
+}
+
+bool PropertyHandle::set(unsigned value)
+{
+   return static_cast<PropertyHandleImpl*>(this)->set_impl(value);
+}
+
+bool PropertyHandle::set(uint64_t value)
+{
+   return static_cast<PropertyHandleImpl*>(this)->set_impl(value);
+}
+
+bool PropertyHandle::set(float value)
+{
+   return static_cast<PropertyHandleImpl*>(this)->set_impl(value);
+}
+
+bool PropertyHandle::set(double value)
+{
+   return static_cast<PropertyHandleImpl*>(this)->set_impl(value);
+}
+
+bool PropertyHandle::set(long double value)
+{
+   return static_cast<PropertyHandleImpl*>(this)->set_impl(value);
+}
+
+bool PropertyHandle::set(const std::string& value)
+{
+   return static_cast<PropertyHandleImpl*>(this)->set_impl(value);
+}
+
+bool PropertyHandle::set(const std::vector<char>& value)
+{
+   return static_cast<PropertyHandleImpl*>(this)->set_impl(BlobHolder(value));
+}
+
+bool PropertyHandle::set(void* data, size_t size)
+{
+   return static_cast<PropertyHandleImpl*>(this)->set_impl(BlobHolder(data, size));
+}
+
+bool PropertyHandle::remove()
+{
+   return static_cast<PropertyHandleImpl*>(this)->remove_impl();
+}
+
+
+PropertyHandleImpl::PropertyHandleImpl(Storage* storage, const std::string& node_path, const std::string& property_name)
+   : storage(storage)
+   , node_path(node_path)
+   , property_name(property_name)
+{
+}
+
+template<typename T>
+bool PropertyHandleImpl::get_impl(T& value) const
+{
+   lock_guard locker(lock);
+   std::shared_ptr<NodeImpl> node = get_node();
+   if (!node) {
+      return false;
+   }
+
+   return node->get_property_impl(slot, property_name, value);
+}
+
+template<typename T>
+bool PropertyHandleImpl::set_impl(const T& value)
+{
+   lock_guard locker(lock);
+   std::shared_ptr<NodeImpl> node = get_node();
+   if (!node) {
+      return false;
+   }
+
+   node->set_property_impl(slot, property_name, value);
+   return true;
+}
+
+bool PropertyHandleImpl::remove_impl()
+{
+   lock_guard locker(lock);
+   std::shared_ptr<NodeImpl> node = get_node();
+   if (!node) {
+      return false;
+   }
+
+   return node->remove_property_impl(property_name);
+}
+
+std::shared_ptr<NodeImpl> PropertyHandleImpl::get_node() const
+{
+   uint64_t current_generation = storage->get_paths_generation();
+   if (!node || current_generation != paths_generation || node->is_path_changed(paths_version) || node->is_deleted_impl()) {
+      paths_version = NodeImpl::get_paths_version();
+      node = storage->find_node(node_path);
+      paths_generation = current_generation;
+      slot = NodeImpl::PropertySlot();
+   } else if (node->is_path_expired()) {
+      // Reused node isn't filtered by the lookup, neither are its ancestors
+      return nullptr;
+   } else {
+      // Access through the handle extends sliding time to live, like a lookup
+      node->touch();
+   }
+   return node;
+}
+
+}
@@ -0,0 +1,42 @@
+#ifndef HKEYSTORE_PROPERTY_HANDLE_IMPL_H
+#define HKEYSTORE_PROPERTY_HANDLE_IMPL_H
+
+#include <memory>
+#include <string>
+#include <mutex>
+
+#include <property_handle.h>
+#include <storage.h>
+
+#include "node_impl.h"
+
+namespace hks {
+
+class PropertyHandleImpl : public PropertyHandle
+{
+public:
+   PropertyHandleImpl(Storage* storage, const std::string& node_path, const std::string& property_name);
+
+   template<typename T> bool get_impl(T& value) const;
+   template<typename T> bool set_impl(const T& value);
+   bool remove_impl();
+
+private:
+   using lock_guard = std::lock_guard<std::mutex>;
+
+   std::shared_ptr<NodeImpl> get_node() const;
+
+   Storage* storage;
+   std::string node_path;
+   std::string property_name;
+
+   mutable std::mutex lock;
+   mutable std::shared_ptr<NodeImpl> node;
+   mutable uint64_t paths_generation = 0;
+   mutable uint64_t paths_version = 0;
+   mutable NodeImpl::PropertySlot slot;
+};
+
+}
+
+#endif
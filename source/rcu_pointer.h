@@ -0,0 +1,129 @@
+#ifndef HKEYSTORE_RCU_POINTER_H
+#define HKEYSTORE_RCU_POINTER_H
+
+#include <memory>
+#include <array>
+#include <atomic>
+#include <thread>
+
+namespace hks {
+
+// Pointer to an immutable object, which is read without locks and replaced by writers
+//
+// Readers register in one of two reader counters of their shard, selected by the current phase.
+// Writer publishes the new object, then flips the phase twice, each time waiting until readers
+// of the previous phase leave. After that nobody can hold the old object and it's deleted.
+// Writers have to be serialized by the caller
+
+template<typename T>
+class RcuPointer
+{
+public:
+   class ReadLock
+   {
+   public:
+      ReadLock(const RcuPointer& pointer);
+      ~ReadLock();
+
+      ReadLock(const ReadLock&) = delete;
+      void operator=(const ReadLock&) = delete;
+
+      const T* get() const { return value; }
+      const T* operator->() const { return value; }
+      const T& operator*() const { return *value; }
+
+   private:
+      std::atomic<int64_t>& readers_count;
+      const T* value;
+   };
+
+   explicit RcuPointer(std::unique_ptr<T> value);
+   ~RcuPointer();
+
+   RcuPointer(const RcuPointer&) = delete;
+   void operator=(const RcuPointer&) = delete;
+
+   ReadLock read() const { return ReadLock(*this); }
+
+   // Current object for writers
+   const T& get() const { return *value.load(); }
+   // Returns after all readers of the old object have left
+   void update(std::unique_ptr<T> new_value);
+
+private:
+   static const size_t SHARDS_COUNT = 64;
+
+   struct alignas(64) Shard
+   {
+      std::atomic<int64_t> readers_count[2] = { 0, 0 };
+   };
+
+   std::atomic<int64_t>& enter() const;
+   void wait_for_readers(size_t readers_phase) const;
+
+   std::atomic<T*> value;
+   std::atomic<size_t> phase = 0;
+   mutable std::array<Shard, SHARDS_COUNT> shards;
+};
+
+
+template<typename T>
+RcuPointer<T>::ReadLock::ReadLock(const RcuPointer& pointer)
+   : readers_count(pointer.enter())
+   , value(pointer.value.load())
+{
+}
+
+template<typename T>
+RcuPointer<T>::ReadLock::~ReadLock()
+{
+   readers_count.fetch_sub(1);
+}
+
+template<typename T>
+RcuPointer<T>::RcuPointer(std::unique_ptr<T> value)
+   : value(value.release())
+{
+}
+
+template<typename T>
+RcuPointer<T>::~RcuPointer()
+{
+   delete value.load();
+}
+
+template<typename T>
+void RcuPointer<T>::update(std::unique_ptr<T> new_value)
+{
+   std::unique_ptr<T> old_value(value.exchange(new_value.release()));
+
+   // Reader could take the phase just before the flip, so both phases are drained
+   for (int i = 0; i < 2; i++) {
+      size_t old_phase = phase.fetch_xor(1);
+      wait_for_readers(old_phase);
+   }
+}
+
+template<typename T>
+std::atomic<int64_t>& RcuPointer<T>::enter() const
+{
+   static thread_local size_t i_shard = std::hash<std::thread::id>()(std::this_thread::get_id()) % SHARDS_COUNT;
+
+   std::atomic<int64_t>& readers_count = shards[i_shard].readers_count[phase.load()];
+   readers_count.fetch_add(1);
+   return readers_count;
+}
+
+template<typename T>
+void RcuPointer<T>::wait_for_readers(size_t readers_phase) const
+{
+   for (auto& shard : shards) {
+      while (shard.readers_count[readers_phase].load() != 0) {
+         std::this_thread::yield();
+      }
+   }
+}
+
+}
+
+#endif
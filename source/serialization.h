@@ -32,6 +32,21 @@ auto deserialize(std::istream& is, T& value) -> decltype(value.deserialize(is))
    value.deserialize(is);
 }
 
+template<typename clock>
+inline void deserialize(std::istream& is, std::chrono::time_point<clock>& tp)
+{
+   std::chrono::milliseconds::rep millis;
+   deserialize(is, millis);
+   tp = std::chrono::time_point<clock>(std::chrono::milliseconds(millis));
+}
+
+template<typename clock>
+void serialize(std::ostream& os, const std::chrono::time_point<clock>& tp)
+{
+   std::chrono::milliseconds::rep millis = std::chrono::duration_cast<std::chrono::milliseconds>(tp.time_since_epoch()).count();
+   serialize(os, millis);
+}
+
 template<typename T, int N>
 inline void serialize(std::ostream& os, const T (&array)[N])
 {
@@ -116,21 +131,6 @@ inline void deserialize(std::istream& is, std::unordered_map<key, value>& map)
    }
 }
 
-template<typename clock>
-inline void deserialize(std::istream& is, std::chrono::time_point<clock>& tp)
-{
-   std::chrono::milliseconds::rep millis;
-   deserialize(is, millis);
-   tp = std::chrono::time_point<clock>(std::chrono::milliseconds(millis));
-}
-
-template<typename clock>
-void serialize(std::ostream& os, const std::chrono::time_point<clock>& tp)
-{
-   std::chrono::milliseconds::rep millis = std::chrono::duration_cast<std::chrono::milliseconds>(tp.time_since_epoch()).count();
-   serialize(os, millis);
-}
-
 template<typename... Types>
 void serialize(std::ostream& os, const std::variant<Types...>& value)
 {
@@ -145,7 +145,7 @@ void serialize(std::ostream& os, const std::variant<Types...>& value)
 template<int N, typename... Types>
 inline void deserialize_specific_type(std::istream& is, std::variant<Types...>& value)
 {
-   std::variant_alternative_t<N, NodeImpl::PropertyValue> v;
+   std::variant_alternative_t<N, std::variant<Types...>> v;
    deserialize(is, v);
    value = v;
 }
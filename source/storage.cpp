@@ -1,14 +1,45 @@
 #include <storage.h>
+#include <batch.h>
 #include <errors.h>
 #include "volume_impl.h"
 #include "utility.h"
 #include "node_impl.h"
+#include "path_cache.h"
+#include "rcu_pointer.h"
+#include "thread_pool.h"
+#include "metrics_registry.h"
+#include "trace_scope.h"
+#include "property_handle_impl.h"
 
 namespace hks {
 
+Storage::Storage()
+   : Storage(StorageOptions())
+{
+}
+
+Storage::Storage(const StorageOptions& options)
+   : volumes_root(std::make_unique<RcuPointer<MountNode>>(std::make_unique<MountNode>()))
+   , path_cache(std::make_unique<PathCache>(PATH_CACHE_CAPACITY))
+   , options(options)
+{
+}
+
+Storage::~Storage()
+{
+   // Finish asynchronous calls before anything is destroyed
+   thread_pool.reset();
+   detach_volumes(volumes_root->get());
+}
+
 std::shared_ptr<Volume> Storage::open_volume(const std::string& path, bool create_if_not_exist)
 {
-   return std::make_shared<VolumeImpl>(path, create_if_not_exist);
+   return open_volume(path, create_if_not_exist, VolumeOptions());
+}
+
+std::shared_ptr<Volume> Storage::open_volume(const std::string& path, bool create_if_not_exist, const VolumeOptions& options)
+{
+   return std::make_shared<VolumeImpl>(path, create_if_not_exist, options);
 }
 
 void Storage::mount(std::shared_ptr<Volume> volume, const std::string& path)
@@ -24,12 +55,18 @@ void Storage::mount(std::shared_ptr<Volume> volume, const std::string& path, con
    }
    volume_impl->set_storage(this);
 
-   std::unique_lock<std::shared_mutex> lock(volumes_lock);
-   MountNode* node = &volumes_root;
+   std::lock_guard<std::mutex> lock(volumes_lock);
+   // Readers don't lock the mount tree, so it's changed in a copy
+   auto new_root = std::make_unique<MountNode>(volumes_root->get());
+   MountNode* node = new_root.get();
    size_t i_path = 0;
    while (i_path < path.length()) {
-      std::string sub_key = find_next_sub_key(path, i_path);
-      node = &node->nodes[sub_key];
+      std::string_view sub_key = find_next_sub_key(path, i_path);
+      auto it = node->nodes.find(sub_key);
+      if (it == node->nodes.end()) {
+         it = node->nodes.emplace(sub_key, MountNode()).first;
+      }
+      node = &it->second;
    }
 
    std::shared_ptr<NodeImpl> node_to_mount = volume_impl->get_node(node_path);
@@ -38,6 +75,7 @@ void Storage::mount(std::shared_ptr<Volume> volume, const std::string& path, con
    }
 
    node->mount_points.emplace_back(volume_impl, node_path, node_to_mount);
+   mount_points_changed(std::move(new_root));
 }
 
 void Storage::unmount(std::shared_ptr<Volume> volume, const std::string& path)
@@ -49,17 +87,18 @@ void Storage::unmount(std::shared_ptr<Volume> volume, const std::string& path, c
 {
    std::shared_ptr<VolumeImpl> volume_impl = std::static_pointer_cast<VolumeImpl>(volume);
 
-   std::unique_lock<std::shared_mutex> lock(volumes_lock);
+   std::lock_guard<std::mutex> lock(volumes_lock);
+   auto new_root = std::make_unique<MountNode>(volumes_root->get());
 
    std::vector<MountNode*> nodes_stack;
-   std::vector<std::string> keys_stack;
-   nodes_stack.push_back(&volumes_root);
+   std::vector<std::string_view> keys_stack;
+   nodes_stack.push_back(new_root.get());
    keys_stack.push_back("");
 
-   MountNode* node = &volumes_root;
+   MountNode* node = new_root.get();
    size_t i_path = 0;
    while (i_path < path.length()) {
-      std::string sub_key = find_next_sub_key(path, i_path);
+      std::string_view sub_key = find_next_sub_key(path, i_path);
       auto it = node->nodes.find(sub_key);
       if (it == node->nodes.end()) {
          throw LogicError("Volume was not mounted at specified point");
@@ -82,72 +121,67 @@ void Storage::unmount(std::shared_ptr<Volume> volume, const std::string& path, c
    for (size_t i = nodes_stack.size() - 1; i > 0; --i) {
       MountNode* stack_node = nodes_stack[i];
       if (stack_node->mount_points.size() == 0 && stack_node->nodes.size() == 0) {
-         nodes_stack[i - 1]->nodes.erase(keys_stack[i - 1]);
+         nodes_stack[i - 1]->nodes.erase(nodes_stack[i - 1]->nodes.find(keys_stack[i]));
       } else {
          break;
       }
    }
+
+   bool still_mounted = is_mounted(*new_root, volume_impl.get());
+   mount_points_changed(std::move(new_root));
+
+   volume_impl->flush();
+   if (!still_mounted) {
+      volume_impl->set_storage(nullptr);
+   }
 }
 
 
 std::shared_ptr<Node> Storage::get_node(const std::string& path) const
 {
-   std::shared_lock<std::shared_mutex> lock(volumes_lock);
-   const MountNode* node = &volumes_root;
-   size_t i_path = 0;
-   while (true) {
-      for (auto& mount_point : node->mount_points) {
-         std::shared_ptr<Node> node = mount_point.node->get_node_impl(get_path_tail(path, i_path));
-         if (node) {
-            return node;
-         }
-      }
-
-      if (i_path == path.length()) {
-         return nullptr;
-      }
+   ScopedTimer timer(Histogram::storage_get_node);
 
-      std::string sub_key = find_next_sub_key(path, i_path);
-      auto it = node->nodes.find(sub_key);
-      if (it == node->nodes.end()) {
-         return nullptr;
-      }
-      node = &it->second;
-   }
+   return find_node(path);
 }
 
 std::shared_ptr<Node> Storage::add_node(const std::string& path, const std::string& name)
 {
-   std::shared_ptr<Node> parent = get_node(path);
+   ScopedTimer timer(Histogram::storage_add_node);
+
+   std::shared_ptr<NodeImpl> parent = find_node(path);
    if (parent == nullptr) {
       throw NoSuchNode("Node '" + path + "' doesn't exist");
    }
 
-   return parent->add_child(name);
+   return parent->add_child_impl(name);
 }
 
 void Storage::remove_node(const std::string& path)
 {
-   std::string parent_path;
-   std::string node_name;
+   ScopedTimer timer(Histogram::storage_remove_node);
+
+   std::string_view parent_path;
+   std::string_view node_name;
    split_node_path(path, parent_path, node_name);
-   std::shared_ptr<Node> parent = get_node(parent_path);
+   std::shared_ptr<NodeImpl> parent = find_node(parent_path);
    if (parent == nullptr) {
       throw NoSuchNode("Node '" + path + "' doesn't exist");
    }
-   parent->remove_child(node_name);
+   parent->remove_child_impl(std::string(node_name));
 }
 
 void Storage::rename_node(const std::string& path, const std::string& new_name)
 {
-   std::string parent_path;
-   std::string node_name;
+   ScopedTimer timer(Histogram::storage_rename_node);
+
+   std::string_view parent_path;
+   std::string_view node_name;
    split_node_path(path, parent_path, node_name);
-   std::shared_ptr<Node> parent = get_node(parent_path);
+   std::shared_ptr<NodeImpl> parent = find_node(parent_path);
    if (parent == nullptr) {
       throw NoSuchNode("Node '" + path + "' doesn't exist");
    }
-   parent->rename_child(node_name, new_name);
+   parent->rename_child_impl(std::string(node_name), new_name);
 }
 
 bool Storage::get_property(const std::string& path, int& value) const
@@ -247,30 +281,231 @@ bool Storage::set_property(const std::string& path, void* data, size_t size)
 
 bool Storage::remove_property(const std::string& path)
 {
-   std::string node_path;
-   std::string property_name;
+   ScopedTimer timer(Histogram::storage_remove_property);
+
+   std::string_view node_path;
+   std::string_view property_name;
    if (!split_property_path(path, node_path, property_name)) {
       throw LogicError(path + " is not a valid property path");
    }
 
-   std::shared_ptr<NodeImpl> node = std::static_pointer_cast<NodeImpl>(get_node(node_path));
+   std::shared_ptr<NodeImpl> node = find_node(node_path);
    if (!node) {
       return false;
    }
 
-   return node->remove_property(property_name);
+   return node->remove_property_impl(property_name);
+}
+
+std::vector<std::optional<Value>> Storage::get_properties(const std::vector<std::string>& paths) const
+{
+   ScopedTimer timer(Histogram::storage_get_properties);
+
+   std::vector<std::optional<Value>> values(paths.size());
+
+   // Ordered map keeps nodes with common path prefixes next to each other
+   std::map<std::string_view, std::vector<NodeImpl::PropertyRead>> reads_by_node_paths;
+   for (size_t i = 0; i < paths.size(); i++) {
+      std::string_view node_path;
+      std::string_view property_name;
+      if (!split_property_path(paths[i], node_path, property_name)) {
+         throw LogicError(paths[i] + " is not a valid property path");
+      }
+      reads_by_node_paths[node_path].push_back({ property_name, &values[i] });
+   }
+
+   for (auto& node_reads : reads_by_node_paths) {
+      std::shared_ptr<NodeImpl> node = find_node(node_reads.first);
+      if (node) {
+         node->get_property_values(node_reads.second);
+      }
+   }
+
+   return values;
+}
+
+std::vector<bool> Storage::set_properties(const std::vector<std::pair<std::string, Value>>& properties)
+{
+   ScopedTimer timer(Histogram::storage_set_properties);
+
+   std::vector<bool> results(properties.size(), false);
+
+   std::map<std::string_view, std::vector<std::pair<size_t, std::string_view>>> names_by_node_paths;
+   for (size_t i = 0; i < properties.size(); i++) {
+      std::string_view node_path;
+      std::string_view property_name;
+      if (!split_property_path(properties[i].first, node_path, property_name)) {
+         throw LogicError(properties[i].first + " is not a valid property path");
+      }
+      names_by_node_paths[node_path].push_back({ i, property_name });
+   }
+
+   std::vector<NodeImpl::PropertyChange> changes;
+   for (auto& node_names : names_by_node_paths) {
+      std::shared_ptr<NodeImpl> node = find_node(node_names.first);
+      if (!node) {
+         continue;
+      }
+
+      changes.clear();
+      for (auto& index_name : node_names.second) {
+         changes.push_back({ std::string(index_name.second), &properties[index_name.first].second });
+      }
+      node->apply_property_changes(changes);
+
+      // Set only when the node is changed
+      for (auto& index_name : node_names.second) {
+         results[index_name.first] = true;
+      }
+   }
+
+   return results;
+}
+
+std::shared_ptr<PropertyHandle> Storage::prepare(const std::string& path)
+{
+   std::string_view node_path;
+   std::string_view property_name;
+   if (!split_property_path(path, node_path, property_name)) {
+      throw LogicError(path + " is not a valid property path");
+   }
+
+   return std::make_shared<PropertyHandleImpl>(this, std::string(node_path), std::string(property_name));
+}
+
+void Storage::apply(const Batch& batch)
+{
+   ScopedTimer timer(Histogram::storage_apply);
+
+   batch.apply([&](const std::string& path) { return find_node(path); }, false);
+}
+
+std::future<std::shared_ptr<Node>> Storage::get_node_async(const std::string& path)
+{
+   return get_thread_pool()->submit([this, path]() { return get_node(path); });
+}
+
+std::future<std::shared_ptr<Node>> Storage::add_node_async(const std::string& path, const std::string& name)
+{
+   return get_thread_pool()->submit([this, path, name]() { return add_node(path, name); });
+}
+
+std::future<void> Storage::remove_node_async(const std::string& path)
+{
+   return get_thread_pool()->submit([this, path]() { remove_node(path); });
+}
+
+std::future<void> Storage::rename_node_async(const std::string& path, const std::string& new_name)
+{
+   return get_thread_pool()->submit([this, path, new_name]() { rename_node(path, new_name); });
+}
+
+std::future<std::optional<Value>> Storage::get_property_async(const std::string& path)
+{
+   return get_thread_pool()->submit([this, path]() { return get_properties({ path })[0]; });
+}
+
+std::future<bool> Storage::set_property_async(const std::string& path, const Value& value)
+{
+   return get_thread_pool()->submit([this, path, value]() { return bool(set_properties({ { path, value } })[0]); });
+}
+
+std::future<bool> Storage::remove_property_async(const std::string& path)
+{
+   return get_thread_pool()->submit([this, path]() { return remove_property(path); });
+}
+
+std::future<std::vector<std::optional<Value>>> Storage::get_properties_async(const std::vector<std::string>& paths)
+{
+   return get_thread_pool()->submit([this, paths]() { return get_properties(paths); });
+}
+
+std::future<std::vector<bool>> Storage::set_properties_async(const std::vector<std::pair<std::string, Value>>& properties)
+{
+   return get_thread_pool()->submit([this, properties]() { return set_properties(properties); });
+}
+
+std::future<void> Storage::apply_async(const Batch& batch)
+{
+   return get_thread_pool()->submit([this, batch]() { apply(batch); });
+}
+
+ThreadPool* Storage::get_thread_pool()
+{
+   std::call_once(thread_pool_created, [this]() { thread_pool = std::make_unique<ThreadPool>(options.async_threads_count); });
+   return thread_pool.get();
+}
+
+std::shared_ptr<NodeImpl> Storage::find_node(std::string_view path) const
+{
+   TraceScope trace(TraceEvent::resolve_path, path);
+
+   uint64_t generation = path_cache->get_generation();
+   uint64_t paths_version = NodeImpl::get_paths_version();
+   std::shared_ptr<NodeImpl> node = path_cache->find(path);
+   if (!node) {
+      node = resolve_node(path);
+      if (node) {
+         path_cache->insert(path, node, generation, paths_version);
+      }
+   }
+
+   if (!node) {
+      return nullptr;
+   }
+   // Cached nodes aren't filtered by the lookup, neither are their ancestors
+   if (node->is_path_expired()) {
+      return nullptr;
+   }
+
+   trace.set_node_id(node->get_node_id());
+   node->touch();
+   return node;
+}
+
+std::shared_ptr<NodeImpl> Storage::resolve_node(std::string_view path) const
+{
+   RcuPointer<MountNode>::ReadLock root = volumes_root->read();
+   const MountNode* node = root.get();
+   size_t i_path = 0;
+   while (true) {
+      for (auto& mount_point : node->mount_points) {
+         std::string_view path_tail = get_path_tail(path, i_path);
+         if (!mount_point.volume->might_contain(mount_point.node_path_hash, path_tail)) {
+            continue;
+         }
+
+         std::shared_ptr<NodeImpl> node = mount_point.node->get_node_impl(path_tail);
+         if (node) {
+            return node;
+         }
+      }
+
+      if (i_path == path.length()) {
+         return nullptr;
+      }
+
+      std::string_view sub_key = find_next_sub_key(path, i_path);
+      auto it = node->nodes.find(sub_key);
+      if (it == node->nodes.end()) {
+         return nullptr;
+      }
+      node = &it->second;
+   }
 }
 
 template<typename T>
 bool Storage::set_property_impl(const std::string& path, const T& value)
 {
-   std::string node_path;
-   std::string property_name;
+   ScopedTimer timer(Histogram::storage_set_property);
+
+   std::string_view node_path;
+   std::string_view property_name;
    if (!split_property_path(path, node_path, property_name)) {
       throw LogicError(path + " is not a valid property path");
    }
 
-   std::shared_ptr<NodeImpl> node = std::static_pointer_cast<NodeImpl>(get_node(node_path));
+   std::shared_ptr<NodeImpl> node = find_node(node_path);
    if (!node) {
       return false;
    }
@@ -282,24 +517,105 @@ bool Storage::set_property_impl(const std::string& path, const T& value)
 template<typename T>
 bool Storage::get_property_impl(const std::string& path, T& value) const
 {
-   std::string node_path;
-   std::string property_name;
+   ScopedTimer timer(Histogram::storage_get_property);
+
+   std::string_view node_path;
+   std::string_view property_name;
    if (!split_property_path(path, node_path, property_name)) {
       throw LogicError(path + " is not a valid property path");
    }
 
-   std::shared_ptr<Node> node = get_node(node_path);
+   std::shared_ptr<NodeImpl> node = find_node(node_path);
    if (!node) {
       return false;
    }
 
-   return node->get_property(property_name, value);
+   return node->get_property_impl(property_name, value);
+}
+
+uint64_t Storage::get_paths_generation() const
+{
+   return path_cache->get_generation();
+}
+
+void Storage::node_names_added()
+{
+   if (stacked_mount_points) {
+      path_cache->invalidate();
+   }
+}
+
+void Storage::mount_points_changed(std::unique_ptr<MountNode> new_root)
+{
+   bool stacked = has_stacked_mount_points(*new_root, false);
+   if (stacked) {
+      // Lookups try volumes in turn, filters let them skip volumes without the path
+      enable_path_filters(*new_root);
+   }
+   // Returns when no lookup uses the old tree
+   volumes_root->update(std::move(new_root));
+   stacked_mount_points = stacked;
+   // Cached nodes may belong to the unmounted volume, so they are released
+   path_cache->clear();
+}
+
+bool Storage::has_stacked_mount_points(const MountNode& node, bool mounted_above)
+{
+   if (!node.mount_points.empty() && (mounted_above || node.mount_points.size() > 1)) {
+      return true;
+   }
+
+   for (auto& child : node.nodes) {
+      if (has_stacked_mount_points(child.second, mounted_above || !node.mount_points.empty())) {
+         return true;
+      }
+   }
+   return false;
+}
+
+bool Storage::is_mounted(const MountNode& node, const VolumeImpl* volume)
+{
+   for (auto& mount_point : node.mount_points) {
+      if (mount_point.volume.get() == volume) {
+         return true;
+      }
+   }
+
+   for (auto& child : node.nodes) {
+      if (is_mounted(child.second, volume)) {
+         return true;
+      }
+   }
+   return false;
+}
+
+void Storage::detach_volumes(const MountNode& node)
+{
+   for (auto& mount_point : node.mount_points) {
+      mount_point.volume->set_storage(nullptr);
+   }
+
+   for (auto& child : node.nodes) {
+      detach_volumes(child.second);
+   }
+}
+
+void Storage::enable_path_filters(const MountNode& node)
+{
+   for (auto& mount_point : node.mount_points) {
+      mount_point.volume->enable_path_filter();
+   }
+
+   for (auto& child : node.nodes) {
+      enable_path_filters(child.second);
+   }
 }
 
 
 Storage::MountPoint::MountPoint(std::shared_ptr<VolumeImpl>& volume, const std::string& node_path, std::shared_ptr<NodeImpl>& node)
    : volume(volume)
    , node_path(node_path)
+   , node_path_hash(get_path_hash(ROOT_PATH_HASH, node_path))
    , node(node)
 {
 }
@@ -0,0 +1,69 @@
+#include "subtree_remover.h"
+#include "time_to_live_scheduler.h"
+#include "node_impl.h"
+
+namespace hks {
+
+SubtreeRemover::~SubtreeRemover()
+{
+   wait();
+}
+
+void SubtreeRemover::add(std::shared_ptr<NodeImpl> node)
+{
+   // Descendants left to the tasks reference the deleted node in the node records table, so they are found after a crash
+   std::vector<std::shared_ptr<NodeImpl>> children;
+   node->delete_node(children);
+   if (children.empty()) {
+      return;
+   }
+
+   lock_guard locker(lock);
+   nodes_to_delete.insert(nodes_to_delete.end(), std::make_move_iterator(children.begin()), std::make_move_iterator(children.end()));
+   post_tasks();
+}
+
+void SubtreeRemover::wait()
+{
+   std::unique_lock<std::mutex> locker(lock);
+   tasks_finished.wait(locker, [this]() { return tasks_count == 0; });
+}
+
+void SubtreeRemover::run_task()
+{
+   // Nodes found in this task are deleted by it, unless it reaches the limit
+   std::vector<std::shared_ptr<NodeImpl>> task_nodes;
+   for (size_t i = 0; i < NODES_PER_TASK; i++) {
+      if (task_nodes.empty()) {
+         lock_guard locker(lock);
+         if (nodes_to_delete.empty()) {
+            break;
+         }
+         task_nodes.push_back(std::move(nodes_to_delete.back()));
+         nodes_to_delete.pop_back();
+      }
+
+      std::shared_ptr<NodeImpl> node = std::move(task_nodes.back());
+      task_nodes.pop_back();
+      node->delete_node(task_nodes);
+   }
+
+   lock_guard locker(lock);
+   nodes_to_delete.insert(nodes_to_delete.end(), std::make_move_iterator(task_nodes.begin()), std::make_move_iterator(task_nodes.end()));
+   tasks_count--;
+   post_tasks();
+   if (tasks_count == 0) {
+      tasks_finished.notify_all();
+   }
+}
+
+void SubtreeRemover::post_tasks()
+{
+   TimeToLiveScheduler& scheduler = TimeToLiveScheduler::get_instance();
+   while (tasks_count < nodes_to_delete.size() && tasks_count < scheduler.get_threads_count()) {
+      tasks_count++;
+      scheduler.post([this]() { run_task(); });
+   }
+}
+
+}
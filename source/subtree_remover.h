@@ -0,0 +1,51 @@
+#ifndef HKEYSTORE_SUBTREE_REMOVER_H
+#define HKEYSTORE_SUBTREE_REMOVER_H
+
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+namespace hks {
+
+class NodeImpl;
+
+// Deletes detached subtrees from the volume file in the time to live threads
+//
+// A task deletes a limited number of nodes and leaves the rest to the next tasks, so a large subtree is shared
+// between the threads and doesn't delay removal of nodes of other volumes.
+// Root of a subtree is deleted at once. If the process stops before its descendants are deleted, they are left
+// with a deleted parent in the node records table and the volume deletes them when it's opened
+
+class SubtreeRemover
+{
+public:
+   SubtreeRemover() = default;
+   ~SubtreeRemover();
+
+   SubtreeRemover(const SubtreeRemover&) = delete;
+   void operator=(const SubtreeRemover&) = delete;
+
+   // Deletes the node at once and its descendants later. The node is removed from its parent after that
+   void add(std::shared_ptr<NodeImpl> node);
+   // Waits until all added subtrees are deleted
+   void wait();
+
+private:
+   using lock_guard = std::lock_guard<std::mutex>;
+
+   static const size_t NODES_PER_TASK = 256;
+
+   void run_task();
+   // Must be called under the lock
+   void post_tasks();
+
+   std::mutex lock;
+   std::condition_variable tasks_finished;
+   std::vector<std::shared_ptr<NodeImpl>> nodes_to_delete;
+   size_t tasks_count = 0;
+};
+
+}
+
+#endif
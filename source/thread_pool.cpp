@@ -0,0 +1,55 @@
+#include <algorithm>
+
+#include "thread_pool.h"
+
+namespace hks {
+
+ThreadPool::ThreadPool(size_t threads_count)
+{
+   threads_count = std::max<size_t>(threads_count, 1);
+   for (size_t i = 0; i < threads_count; i++) {
+      threads.emplace_back(&ThreadPool::worker_function, this);
+   }
+}
+
+ThreadPool::~ThreadPool()
+{
+   {
+      lock_guard locker(lock);
+      exit = true;
+   }
+   work_ready.notify_all();
+
+   for (auto& thread : threads) {
+      thread.join();
+   }
+}
+
+void ThreadPool::post(std::function<void()> task)
+{
+   {
+      lock_guard locker(lock);
+      tasks.push_back(std::move(task));
+   }
+   work_ready.notify_one();
+}
+
+void ThreadPool::worker_function()
+{
+   while (true) {
+      std::function<void()> task;
+      {
+         std::unique_lock<std::mutex> locker(lock);
+         work_ready.wait(locker, [this]() { return exit || !tasks.empty(); });
+         if (tasks.empty()) {
+            return;
+         }
+         task = std::move(tasks.front());
+         tasks.pop_front();
+      }
+
+      task();
+   }
+}
+
+}
@@ -0,0 +1,60 @@
+#ifndef HKEYSTORE_THREAD_POOL_H
+#define HKEYSTORE_THREAD_POOL_H
+
+#include <memory>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <type_traits>
+
+namespace hks {
+
+// Fixed number of threads executing posted tasks in order of posting
+//
+// Destructor waits until all posted tasks are executed
+
+class ThreadPool
+{
+public:
+   explicit ThreadPool(size_t threads_count);
+   ~ThreadPool();
+
+   ThreadPool(const ThreadPool&) = delete;
+   void operator=(const ThreadPool&) = delete;
+
+   void post(std::function<void()> task);
+
+   // Result or exception of the function is passed to the returned future
+   template<typename F>
+   std::future<std::invoke_result_t<F>> submit(F&& function);
+
+private:
+   using lock_guard = std::lock_guard<std::mutex>;
+
+   void worker_function();
+
+   std::mutex lock;
+   std::condition_variable work_ready;
+   bool exit = false;
+   std::deque<std::function<void()>> tasks;
+   std::vector<std::thread> threads;
+};
+
+
+template<typename F>
+std::future<std::invoke_result_t<F>> ThreadPool::submit(F&& function)
+{
+   // std::function requires copyable callables, so the task is shared
+   auto task = std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(std::forward<F>(function));
+   std::future<std::invoke_result_t<F>> future = task->get_future();
+   post([task]() { (*task)(); });
+   return future;
+}
+
+}
+
+#endif
@@ -1,76 +1,369 @@
+#include <map>
+#include <limits>
+#include <algorithm>
+
 #include "time_to_live_manager.h"
+#include "time_to_live_scheduler.h"
 #include "volume_impl.h"
+#include "node_impl.h"
+#include "metrics_registry.h"
+#include "trace_scope.h"
 
 namespace hks {
 
 TimeToLiveManager::TimeToLiveManager(std::unique_ptr<NodesToRemoveTree>&& nodes_to_remove_tree, VolumeImpl* volume_impl)
    : nodes_to_remove_tree(std::move(nodes_to_remove_tree))
    , volume_impl(volume_impl)
+   , timer_wheel(timepoint::clock::now())
+   , last_flush_time(timepoint::clock::now())
+{
+}
+
+void TimeToLiveManager::start()
 {
-   thread = std::thread(&TimeToLiveManager::worker_function, this);
+   // Nodes which expired while the volume was closed are removed first
+   TimeToLiveScheduler::get_instance().add(this);
+   TimeToLiveScheduler::get_instance().schedule(this, timepoint::clock::now());
+}
+
+void TimeToLiveManager::stop()
+{
+   TimeToLiveScheduler::get_instance().remove(this);
+   subtree_remover.wait();
+
+   // Times of this session are restored from the tree
+   flush();
 }
 
-TimeToLiveManager::~TimeToLiveManager()
+void TimeToLiveManager::flush()
 {
+   save_sliding_nodes();
+
+   lock_guard locker(lock);
+   if (!changed_timers.empty()) {
+      flush_timers(timepoint::clock::now());
+   }
+}
+
+TimeToLiveManager::timepoint TimeToLiveManager::remove_expired_nodes()
+{
+   std::vector<Entry> expired;
+   // Keys of expired nodes, removed from the tree after the nodes
+   std::vector<node_to_remove_key_t> expired_keys;
+   timepoint now = timepoint::clock::now();
+
    {
       lock_guard locker(lock);
-      exit = true;
+
+      std::vector<removal_target_t> expired_timers;
+      timer_wheel.advance(now, expired_timers);
+      std::unordered_set<removal_target_t, removal_target_hash_t> expired_targets(expired_timers.begin(), expired_timers.end());
+      for (auto& target : expired_timers) {
+         auto it = timers.find(target);
+         Timer& timer = it->second;
+         if (timer.stored_time != timepoint()) {
+            expired_keys.push_back(node_to_remove_key_t(timer.stored_time, target));
+         }
+         expired.push_back(Entry(node_to_remove_key_t(timer.time, target), timer.changed_node_id));
+         changed_timers.erase(target);
+         timers.erase(it);
+      }
+
+      std::vector<Entry> expired_entries;
+      if (expired.size() < MAX_BATCH_SIZE) {
+         nodes_to_remove_tree->get_until(node_to_remove_key_t(now, std::numeric_limits<node_id_t>::max()), MAX_BATCH_SIZE - expired.size(), expired_entries);
+      }
+      bool has_changed_keys = false;
+      for (auto& entry : expired_entries) {
+         removal_target_t target = entry.first.get_target();
+         auto it = timers.find(target);
+         if (it != timers.end()) {
+            // The target has a timer, its changed time replaces the key on flush
+            has_changed_keys = has_changed_keys || it->second.time != it->second.stored_time;
+            continue;
+         }
+         if (expired_targets.count(target) == 0) {
+            expired.push_back(entry);
+         }
+         expired_keys.push_back(entry.first);
+      }
+
+      if (!changed_timers.empty() && (has_changed_keys || changed_timers.size() >= MAX_CHANGED_TIMERS || now - last_flush_time >= FLUSH_INTERVAL)) {
+         flush_timers(now);
+      }
+
+      if (expired.empty()) {
+         next_time_to_remove = get_next_time();
+         // Times of the wheel are rounded up to its ticks
+         timepoint first_time = next_time_to_remove - std::chrono::milliseconds(1);
+         first_expiry_time.store(first_time.time_since_epoch().count(), std::memory_order_relaxed);
+         return next_time_to_remove;
+      }
+      next_time_to_remove = timepoint();
+      first_expiry_time.store(0, std::memory_order_relaxed);
    }
 
-   work_ready.notify_all();
-   thread.join();
+   remove_nodes(expired, now);
+
+   std::sort(expired_keys.begin(), expired_keys.end());
+   expired_keys.erase(std::unique(expired_keys.begin(), expired_keys.end(), [](const node_to_remove_key_t& lhs, const node_to_remove_key_t& rhs) {
+      return !(lhs < rhs) && !(rhs < lhs);
+   }), expired_keys.end());
+
+   {
+      lock_guard locker(lock);
+      nodes_to_remove_tree->remove(expired_keys);
+   }
+
+   // More nodes may have expired, other volumes are processed first
+   return timepoint::clock::now();
 }
 
-void TimeToLiveManager::worker_function()
+void TimeToLiveManager::flush_timers(timepoint now)
 {
-   while (!exit) {
-      node_to_remove_key_t node_to_remove_key;
-      std::vector<node_id_t> node_path_to_remove;
+   std::vector<node_to_remove_key_t> stored_keys;
+   for (auto& target : changed_timers) {
+      const Timer& timer = timers.at(target);
+      if (timer.stored_time != timepoint()) {
+         stored_keys.push_back(node_to_remove_key_t(timer.stored_time, target));
+      }
+   }
+   std::sort(stored_keys.begin(), stored_keys.end());
+   nodes_to_remove_tree->remove(stored_keys);
 
-      {
-         std::unique_lock<std::mutex> locker(lock);
-         bool res = nodes_to_remove_tree->get_first(&node_to_remove_key, &node_path_to_remove);
-         if (!res) {
-            next_time_to_remove = timepoint();
-            work_ready.wait(locker);
-            continue;
-         }
+   std::vector<Entry> entries;
+   entries.reserve(changed_timers.size());
+   for (auto& target : changed_timers) {
+      const Timer& timer = timers.at(target);
+      entries.push_back(Entry(node_to_remove_key_t(timer.time, target), timer.changed_node_id));
+   }
+   std::sort(entries.begin(), entries.end(), [](const Entry& lhs, const Entry& rhs) { return lhs.first < rhs.first; });
+   nodes_to_remove_tree->insert(entries);
 
-         duration remove_after = node_to_remove_key.time - timepoint::clock::now();
-         if (remove_after > duration()) {
-            next_time_to_remove = node_to_remove_key.time;
-            if (work_ready.wait_for(locker, remove_after) == std::cv_status::no_timeout) {
-               continue;
-            }
-         }
+   for (auto& target : changed_timers) {
+      auto it = timers.find(target);
+      Timer& timer = it->second;
+      timer.stored_time = timer.time;
+      if (timer.time > now + NEAR_TERM) {
+         // Expires from the tree unless it's changed again
+         timer_wheel.cancel(target);
+         timers.erase(it);
       }
+   }
 
-      volume_impl->remove_node(node_path_to_remove);
+   changed_timers.clear();
+   last_flush_time = now;
+}
 
-      {
-         lock_guard locker(lock);
-         next_time_to_remove = timepoint();
-         nodes_to_remove_tree->remove(node_to_remove_key);
+TimeToLiveManager::timepoint TimeToLiveManager::get_next_time()
+{
+   timepoint next_time = timer_wheel.get_next_time();
+
+   // Keys of nodes with timers expire with the timers or change on flush
+   node_to_remove_key_t first_key;
+   node_id_t first_changed_node_id;
+   if (nodes_to_remove_tree->get_first(&first_key, &first_changed_node_id) && timers.count(first_key.get_target()) == 0) {
+      next_time = std::min(next_time, first_key.time);
+   }
+
+   if (!changed_timers.empty()) {
+      next_time = std::min(next_time, last_flush_time + std::chrono::duration_cast<duration>(FLUSH_INTERVAL));
+   }
+   return next_time;
+}
+
+void TimeToLiveManager::remove_nodes(const std::vector<Entry>& expired, timepoint now)
+{
+   // Nodes are grouped by parents and properties by nodes, so each node is looked up once
+   std::map<node_id_t, std::vector<node_id_t>> children_by_parents;
+   std::map<node_id_t, std::vector<uint64_t>> properties_by_nodes;
+   for (auto& entry : expired) {
+      if (entry.first.property_hash != 0) {
+         properties_by_nodes[entry.second].push_back(entry.first.property_hash);
+      } else {
+         children_by_parents[entry.second].push_back(entry.first.node_id);
+      }
+   }
+
+   for (auto& node_properties : properties_by_nodes) {
+      std::shared_ptr<NodeImpl> node = volume_impl->get_node_by_id(node_properties.first);
+      if (node != nullptr) {
+         node->remove_expired_properties(node_properties.second, now);
       }
    }
+
+   for (auto& parent_children : children_by_parents) {
+      std::shared_ptr<NodeImpl> parent = volume_impl->get_node_by_id(parent_children.first);
+      if (parent == nullptr) {
+         // Parent was removed, possibly it has expired earlier in this batch
+         continue;
+      }
+
+      ScopedTimer timer(Histogram::time_to_live_removal);
+      TraceScope trace(TraceEvent::time_to_live_removal, parent->get_node_id(), 0, parent_children.second.size());
+      metrics::increment(Counter::time_to_live_removals, parent->remove_children_impl(parent_children.second, now, subtree_remover));
+   }
 }
 
-void TimeToLiveManager::set_time_to_remove(const std::vector<node_id_t>& node_path, timepoint time_to_remove, timepoint previous_time_to_remove)
+void TimeToLiveManager::set_time_to_remove(node_id_t node_id, node_id_t parent_node_id, timepoint time_to_remove, timepoint previous_time_to_remove)
 {
+   set_time_to_remove(removal_target_t{ node_id, 0 }, parent_node_id, time_to_remove, previous_time_to_remove);
+}
+
+void TimeToLiveManager::set_property_time_to_remove(node_id_t node_id, uint64_t property_hash, timepoint time_to_remove,
+   timepoint previous_time_to_remove)
+{
+   set_time_to_remove(removal_target_t{ node_id, property_hash }, node_id, time_to_remove, previous_time_to_remove);
+}
+
+void TimeToLiveManager::set_times_to_remove(node_id_t parent_node_id, const std::vector<TimeToRemove>& times_to_remove)
+{
+   if (times_to_remove.empty()) {
+      return;
+   }
+
    lock_guard locker(lock);
-   if (previous_time_to_remove != timepoint()) {
-      nodes_to_remove_tree->remove(node_to_remove_key_t(previous_time_to_remove, node_path.back()));
-      if (next_time_to_remove == previous_time_to_remove) {
-         work_ready.notify_all();
-      }
+   timepoint first_time_to_remove = timepoint::max();
+   std::vector<Entry> first_entries;
+   for (auto& time_to_remove : times_to_remove) {
+      set_timer(removal_target_t{ time_to_remove.node_id, 0 }, parent_node_id, time_to_remove.time, time_to_remove.previous_time,
+         first_entries);
+      first_time_to_remove = std::min(first_time_to_remove, time_to_remove.time);
+   }
+   store_first_entries(first_entries);
+   schedule(first_time_to_remove);
+}
+
+void TimeToLiveManager::set_time_to_remove(const removal_target_t& target, node_id_t changed_node_id, timepoint time_to_remove,
+   timepoint previous_time_to_remove)
+{
+   lock_guard locker(lock);
+   std::vector<Entry> first_entries;
+   set_timer(target, changed_node_id, time_to_remove, previous_time_to_remove, first_entries);
+   store_first_entries(first_entries);
+   schedule(time_to_remove);
+}
+
+void TimeToLiveManager::set_timer(const removal_target_t& target, node_id_t changed_node_id, timepoint time_to_remove,
+   timepoint previous_time_to_remove, std::vector<Entry>& first_entries)
+{
+   if (time_to_remove < get_first_expiry_time()) {
+      first_expiry_time.store(time_to_remove.time_since_epoch().count(), std::memory_order_relaxed);
    }
-   if (time_to_remove != timepoint()) {
-      nodes_to_remove_tree->insert(node_to_remove_key_t(time_to_remove, node_path.back()), node_path);
-      if (next_time_to_remove == timepoint() || next_time_to_remove > time_to_remove) {
-         work_ready.notify_all();
+
+   auto it = timers.find(target);
+   if (it == timers.end()) {
+      // The previous time is in the tree, if there is one
+      it = timers.insert({ target, Timer() }).first;
+      it->second.stored_time = previous_time_to_remove;
+      it->second.changed_node_id = changed_node_id;
+   }
+
+   it->second.time = time_to_remove;
+   if (it->second.stored_time == timepoint()) {
+      // The target has no key yet, it's written at once as the node is already saved with its time
+      first_entries.push_back(Entry(node_to_remove_key_t(time_to_remove, target), changed_node_id));
+      it->second.stored_time = time_to_remove;
+      if (time_to_remove > timepoint::clock::now() + NEAR_TERM) {
+         timers.erase(it);
+         return;
       }
+   } else {
+      changed_timers.insert(target);
+   }
+   timer_wheel.schedule(target, time_to_remove);
+}
+
+void TimeToLiveManager::store_first_entries(std::vector<Entry>& first_entries)
+{
+   if (first_entries.empty()) {
+      return;
+   }
+   std::sort(first_entries.begin(), first_entries.end(), [](const Entry& lhs, const Entry& rhs) { return lhs.first < rhs.first; });
+   nodes_to_remove_tree->insert(first_entries);
+}
+
+void TimeToLiveManager::schedule(timepoint time_to_remove)
+{
+   if (changed_timers.size() >= MAX_CHANGED_TIMERS) {
+      TimeToLiveScheduler::get_instance().schedule(this, timepoint::clock::now());
+   } else if (time_to_remove < next_time_to_remove) {
+      TimeToLiveScheduler::get_instance().schedule(this, time_to_remove);
+   }
+}
+
+TimeToLiveManager::timepoint TimeToLiveManager::get_first_expiry_time() const
+{
+   return timepoint(duration(first_expiry_time.load(std::memory_order_relaxed)));
+}
+
+void TimeToLiveManager::remove_subtree(std::shared_ptr<NodeImpl> node)
+{
+   subtree_remover.add(node);
+}
+
+void TimeToLiveManager::set_sliding_node(node_id_t node_id, std::chrono::milliseconds idle_time)
+{
+   std::unique_lock<std::shared_mutex> locker(sliding_nodes_lock);
+   if (idle_time.count() == 0) {
+      sliding_nodes.erase(node_id);
+      return;
    }
+
+   SlidingNode& sliding_node = sliding_nodes[node_id];
+   sliding_node.last_access_time.store(timepoint::clock::now().time_since_epoch().count(), std::memory_order_relaxed);
 }
 
+void TimeToLiveManager::remove_sliding_node(node_id_t node_id)
+{
+   std::unique_lock<std::shared_mutex> locker(sliding_nodes_lock);
+   sliding_nodes.erase(node_id);
 }
 
+bool TimeToLiveManager::touch(node_id_t node_id)
+{
+   std::shared_lock<std::shared_mutex> locker(sliding_nodes_lock);
+   auto it = sliding_nodes.find(node_id);
+   if (it == sliding_nodes.end()) {
+      return false;
+   }
+   it->second.last_access_time.store(timepoint::clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+   if (!it->second.accessed.load(std::memory_order_relaxed)) {
+      it->second.accessed.store(true, std::memory_order_relaxed);
+   }
+   return true;
+}
+
+bool TimeToLiveManager::get_last_access_time(node_id_t node_id, timepoint& last_access_time) const
+{
+   std::shared_lock<std::shared_mutex> locker(sliding_nodes_lock);
+   auto it = sliding_nodes.find(node_id);
+   if (it == sliding_nodes.end()) {
+      return false;
+   }
+   last_access_time = timepoint(duration(it->second.last_access_time.load(std::memory_order_relaxed)));
+   return true;
+}
+
+void TimeToLiveManager::save_sliding_nodes()
+{
+   std::vector<node_id_t> accessed_node_ids;
+   {
+      std::shared_lock<std::shared_mutex> locker(sliding_nodes_lock);
+      for (auto& sliding_node : sliding_nodes) {
+         if (sliding_node.second.accessed.exchange(false, std::memory_order_relaxed)) {
+            accessed_node_ids.push_back(sliding_node.first);
+         }
+      }
+   }
+
+   // Nodes are saved with their extended times to remove, which they have after the volume is opened again
+   for (node_id_t node_id : accessed_node_ids) {
+      std::shared_ptr<NodeImpl> node = volume_impl->get_node_by_id(node_id);
+      if (node != nullptr) {
+         node->reschedule_time_to_remove(timepoint());
+      }
+   }
+}
+
+}
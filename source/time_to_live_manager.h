@@ -3,43 +3,135 @@
 
 #include <memory>
 #include <chrono>
-#include <thread>
 #include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <shared_mutex>
+#include <atomic>
 
 #include "bplus_tree.h"
 #include "node_to_remove_key.h"
+#include "timer_wheel.h"
+#include "subtree_remover.h"
 
 namespace hks {
 
 class VolumeImpl;
 
+// Removes nodes and properties when their time to live expires
+//
+// The first time of a node or property is written to the persistent tree at once. Later times set in this session
+// are kept in a timer wheel and written to the tree in batches, so frequent refreshes of the same node cost no tree
+// changes. After a crash the previous key, which expires earlier, reschedules the node to its saved time. The tree has
+// times of previous sessions and times of timers which expire later than NEAR_TERM, it's the source of times after the
+// volume is opened again. Its values are ids of nodes, which are changed by removals: parents of removed nodes and
+// nodes of removed properties.
+
 class TimeToLiveManager
 {
 public:
-   using NodesToRemoveTree = BplusTree<node_to_remove_key_t, std::vector<node_id_t>>;
+   using NodesToRemoveTree = BplusTree<node_to_remove_key_t, node_id_t>;
    using timepoint = node_to_remove_key_t::timepoint;
    using duration = timepoint::duration;
 
+   struct TimeToRemove
+   {
+      node_id_t node_id;
+      timepoint time;
+      timepoint previous_time;
+   };
+
    TimeToLiveManager(std::unique_ptr<NodesToRemoveTree>&& nodes_to_remove_tree, VolumeImpl* volume_impl);
-   ~TimeToLiveManager();
+
+   // Removals reach the manager through the volume, so it's started after the volume has it and stopped before it's reset
+   void start();
+   void stop();
 
    TimeToLiveManager(const TimeToLiveManager&) = delete;
    void operator=(const TimeToLiveManager&) = delete;
 
-   void set_time_to_remove(const std::vector<node_id_t>& node_path, timepoint time_to_remove, timepoint previous_time_to_remove);
+   void set_time_to_remove(node_id_t node_id, node_id_t parent_node_id, timepoint time_to_remove, timepoint previous_time_to_remove);
+   void set_property_time_to_remove(node_id_t node_id, uint64_t property_hash, timepoint time_to_remove, timepoint previous_time_to_remove);
+   // Sets times of children of the parent under one lock
+   void set_times_to_remove(node_id_t parent_node_id, const std::vector<TimeToRemove>& times_to_remove);
+
+   // Saves times extended by accesses of sliding nodes and writes changed times to the tree
+   void flush();
+
+   // Sliding nodes keep their last access times here, 0 idle time removes the node
+   void set_sliding_node(node_id_t node_id, std::chrono::milliseconds idle_time);
+   void remove_sliding_node(node_id_t node_id);
+   // Returns false if the node isn't added
+   bool touch(node_id_t node_id);
+   bool get_last_access_time(node_id_t node_id, timepoint& last_access_time) const;
+
+   // Called by the scheduler, returns the time when it has to be called again
+   timepoint remove_expired_nodes();
 
-   void worker_function();
+   // No node or property of the volume expires before this time, so reads don't have to check it until then
+   timepoint get_first_expiry_time() const;
+   // Deletes the node at once and its subtree in the time to live threads, the node is removed from its parent after that
+   void remove_subtree(std::shared_ptr<NodeImpl> node);
 
 private:
    using lock_guard = std::lock_guard<std::mutex>;
+   using Entry = NodesToRemoveTree::entry_t;
+
+   // Expired nodes removed at once, keeps the lock and memory use bounded when a backlog is drained
+   static const size_t MAX_BATCH_SIZE = 4096;
+   // Changed times are written to the tree at this interval or when there are too many of them
+   static constexpr std::chrono::seconds FLUSH_INTERVAL{ 1 };
+   static const size_t MAX_CHANGED_TIMERS = 65536;
+   // Written timers which expire later are left only in the tree
+   static constexpr std::chrono::minutes NEAR_TERM{ 1 };
+
+   struct Timer
+   {
+      timepoint time;
+      // Time of the key in the tree, timepoint() if there is none
+      timepoint stored_time;
+      // Node changed by the removal
+      node_id_t changed_node_id;
+   };
+
+   struct SlidingNode
+   {
+      std::atomic<duration::rep> last_access_time{ 0 };
+      // Accessed after the time to remove was saved
+      std::atomic<bool> accessed{ false };
+   };
+
+   void set_time_to_remove(const removal_target_t& target, node_id_t changed_node_id, timepoint time_to_remove,
+      timepoint previous_time_to_remove);
+   // Must be called under the lock, adds keys of targets which have none to the first entries
+   void set_timer(const removal_target_t& target, node_id_t changed_node_id, timepoint time_to_remove, timepoint previous_time_to_remove,
+      std::vector<Entry>& first_entries);
+   // Must be called under the lock
+   void store_first_entries(std::vector<Entry>& first_entries);
+   // Must be called under the lock, wakes the worker up earlier if it's needed
+   void schedule(timepoint time_to_remove);
+   void remove_nodes(const std::vector<Entry>& expired, timepoint now);
+   void save_sliding_nodes();
+   // Must be called under the lock
+   void flush_timers(timepoint now);
+   // Must be called under the lock, returns the time when the worker has to wake up
+   timepoint get_next_time();
 
    std::mutex lock;
-   std::condition_variable work_ready;
-   bool exit = false;
    std::unique_ptr<NodesToRemoveTree> nodes_to_remove_tree;
-   std::thread thread;
    VolumeImpl* volume_impl;
    timepoint next_time_to_remove;
+   // Changed under the lock
+   std::atomic<duration::rep> first_expiry_time{ 0 };
+
+   std::unordered_map<removal_target_t, Timer, removal_target_hash_t> timers;
+   std::unordered_set<removal_target_t, removal_target_hash_t> changed_timers;
+   TimerWheel<removal_target_t, removal_target_hash_t> timer_wheel;
+   timepoint last_flush_time;
+   SubtreeRemover subtree_remover;
+
+   mutable std::shared_mutex sliding_nodes_lock;
+   std::unordered_map<node_id_t, SlidingNode> sliding_nodes;
 };
 
 }
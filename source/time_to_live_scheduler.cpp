@@ -0,0 +1,161 @@
+#include <algorithm>
+
+#include "time_to_live_scheduler.h"
+#include "time_to_live_manager.h"
+#include "volume.h"
+
+namespace hks {
+
+void set_time_to_live_threads_count(size_t threads_count)
+{
+   TimeToLiveScheduler::get_instance().set_threads_count(threads_count);
+}
+
+TimeToLiveScheduler& TimeToLiveScheduler::get_instance()
+{
+   static TimeToLiveScheduler instance;
+   return instance;
+}
+
+TimeToLiveScheduler::TimeToLiveScheduler()
+{
+}
+
+TimeToLiveScheduler::~TimeToLiveScheduler()
+{
+   {
+      lock_guard locker(lock);
+      exit = true;
+   }
+   work_ready.notify_all();
+
+   if (thread.joinable()) {
+      thread.join();
+   }
+   thread_pool.reset();
+}
+
+void TimeToLiveScheduler::set_threads_count(size_t threads_count)
+{
+   std::unique_ptr<ThreadPool> previous_thread_pool;
+   {
+      lock_guard locker(lock);
+      this->threads_count = std::max<size_t>(threads_count, 1);
+      if (thread_pool) {
+         previous_thread_pool = std::move(thread_pool);
+         thread_pool = std::make_unique<ThreadPool>(this->threads_count);
+      }
+   }
+
+   // Waits for the managers already passed to the previous threads
+   previous_thread_pool.reset();
+}
+
+size_t TimeToLiveScheduler::get_threads_count()
+{
+   lock_guard locker(lock);
+   return threads_count;
+}
+
+void TimeToLiveScheduler::post(std::function<void()> task)
+{
+   lock_guard locker(lock);
+   thread_pool->post(std::move(task));
+}
+
+void TimeToLiveScheduler::add(TimeToLiveManager* manager)
+{
+   lock_guard locker(lock);
+   if (!thread_pool) {
+      // Started by the first volume
+      thread_pool = std::make_unique<ThreadPool>(threads_count);
+      thread = std::thread(&TimeToLiveScheduler::timer_function, this);
+   }
+   schedules[manager] = Schedule();
+}
+
+void TimeToLiveScheduler::remove(TimeToLiveManager* manager)
+{
+   std::unique_lock<std::mutex> locker(lock);
+   Schedule& schedule = schedules.at(manager);
+   schedule.removed = true;
+   if (!schedule.processing && schedule.time != timepoint::max()) {
+      queue.erase({ schedule.time, manager });
+   }
+
+   processing_finished.wait(locker, [&]() { return !schedule.processing; });
+   schedules.erase(manager);
+}
+
+void TimeToLiveScheduler::schedule(TimeToLiveManager* manager, timepoint time)
+{
+   lock_guard locker(lock);
+   auto it = schedules.find(manager);
+   if (it == schedules.end()) {
+      // Times set while the volume is closed are only flushed
+      return;
+   }
+   Schedule& schedule = it->second;
+   if (schedule.removed || time >= schedule.time) {
+      return;
+   }
+
+   if (schedule.processing) {
+      // Scheduled when the processing is finished
+      schedule.time = time;
+      return;
+   }
+
+   if (schedule.time != timepoint::max()) {
+      queue.erase({ schedule.time, manager });
+   }
+   schedule.time = time;
+   queue.insert({ time, manager });
+   if (queue.begin()->second == manager) {
+      work_ready.notify_all();
+   }
+}
+
+void TimeToLiveScheduler::timer_function()
+{
+   std::unique_lock<std::mutex> locker(lock);
+   while (!exit) {
+      if (queue.empty()) {
+         work_ready.wait(locker);
+         continue;
+      }
+
+      auto first = *queue.begin();
+      if (first.first > timepoint::clock::now()) {
+         work_ready.wait_until(locker, first.first);
+         continue;
+      }
+
+      queue.erase(queue.begin());
+      Schedule& schedule = schedules.at(first.second);
+      schedule.time = timepoint::max();
+      schedule.processing = true;
+      TimeToLiveManager* manager = first.second;
+      thread_pool->post([this, manager]() { process(manager); });
+   }
+}
+
+void TimeToLiveScheduler::process(TimeToLiveManager* manager)
+{
+   timepoint next_time = manager->remove_expired_nodes();
+
+   {
+      lock_guard locker(lock);
+      Schedule& schedule = schedules.at(manager);
+      schedule.processing = false;
+      schedule.time = std::min(schedule.time, next_time);
+      if (!schedule.removed && schedule.time != timepoint::max()) {
+         queue.insert({ schedule.time, manager });
+      }
+   }
+
+   work_ready.notify_all();
+   processing_finished.notify_all();
+}
+
+}
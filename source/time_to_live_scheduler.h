@@ -0,0 +1,77 @@
+#ifndef HKEYSTORE_TIME_TO_LIVE_SCHEDULER_H
+#define HKEYSTORE_TIME_TO_LIVE_SCHEDULER_H
+
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <set>
+#include <unordered_map>
+
+#include "thread_pool.h"
+
+namespace hks {
+
+class TimeToLiveManager;
+
+// Removes expired nodes of all volumes in the process
+//
+// One timer thread passes managers to the removal thread pool in order of their next times. A manager is processed
+// by one thread at a time, after that it's scheduled again for the time it returns
+
+class TimeToLiveScheduler
+{
+public:
+   using timepoint = std::chrono::time_point<std::chrono::system_clock>;
+
+   static TimeToLiveScheduler& get_instance();
+
+   ~TimeToLiveScheduler();
+
+   TimeToLiveScheduler(const TimeToLiveScheduler&) = delete;
+   void operator=(const TimeToLiveScheduler&) = delete;
+
+   void set_threads_count(size_t threads_count);
+   size_t get_threads_count();
+
+   // Executes the task in the removal threads, after the tasks posted earlier
+   void post(std::function<void()> task);
+
+   void add(TimeToLiveManager* manager);
+   // Waits until the manager isn't processed
+   void remove(TimeToLiveManager* manager);
+   // Processes the manager at the time, unless it's scheduled earlier
+   void schedule(TimeToLiveManager* manager, timepoint time);
+
+private:
+   using lock_guard = std::lock_guard<std::mutex>;
+
+   struct Schedule
+   {
+      // timepoint::max() if the manager isn't scheduled
+      timepoint time = timepoint::max();
+      bool processing = false;
+      // The manager is being removed, it's not scheduled again
+      bool removed = false;
+   };
+
+   TimeToLiveScheduler();
+
+   void timer_function();
+   void process(TimeToLiveManager* manager);
+
+   std::mutex lock;
+   std::condition_variable work_ready;
+   std::condition_variable processing_finished;
+   bool exit = false;
+   std::unordered_map<TimeToLiveManager*, Schedule> schedules;
+   std::set<std::pair<timepoint, TimeToLiveManager*>> queue;
+   size_t threads_count = 2;
+   std::unique_ptr<ThreadPool> thread_pool;
+   std::thread thread;
+};
+
+}
+
+#endif
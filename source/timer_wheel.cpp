@@ -0,0 +1,172 @@
+#include <cassert>
+
+#include "timer_wheel.h"
+#include "node_to_remove_key.h"
+
+namespace hks {
+
+template<typename id_t, typename hash_t>
+TimerWheel<id_t, hash_t>::TimerWheel(timepoint now)
+   : start(now)
+{
+}
+
+template<typename id_t, typename hash_t>
+void TimerWheel<id_t, hash_t>::schedule(const id_t& id, timepoint time)
+{
+   auto it = timers.find(id);
+   if (it != timers.end()) {
+      remove(it->second);
+   } else {
+      it = timers.insert({ id, Timer() }).first;
+   }
+
+   // Timers which are already due expire with the next tick
+   it->second.tick = std::max(to_tick(time), current_tick + 1);
+   place(id, it->second);
+}
+
+template<typename id_t, typename hash_t>
+void TimerWheel<id_t, hash_t>::cancel(const id_t& id)
+{
+   auto it = timers.find(id);
+   if (it == timers.end()) {
+      return;
+   }
+   remove(it->second);
+   timers.erase(it);
+}
+
+template<typename id_t, typename hash_t>
+void TimerWheel<id_t, hash_t>::advance(timepoint now, std::vector<id_t>& expired)
+{
+   uint64_t now_tick = now < start ? 0 : std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count();
+
+   while (current_tick < now_tick) {
+      // Ticks without timers to expire or move are skipped
+      uint64_t next_tick = get_next_tick();
+      if (next_tick > now_tick) {
+         break;
+      }
+      current_tick = next_tick;
+
+      if ((current_tick & ((uint64_t(1) << (SLOT_BITS * LEVELS_COUNT)) - 1)) == 0) {
+         cascade(OVERFLOW_LEVEL, 0);
+      }
+      for (int level = LEVELS_COUNT - 1; level > 0; level--) {
+         if ((current_tick & ((uint64_t(1) << (SLOT_BITS * level)) - 1)) == 0) {
+            cascade(level, (current_tick >> (SLOT_BITS * level)) & (SLOTS_COUNT - 1));
+         }
+      }
+
+      Slot& slot = slots[0][current_tick & (SLOTS_COUNT - 1)];
+      for (auto& id : slot) {
+         timers.erase(id);
+         expired.push_back(std::move(id));
+      }
+      slot.clear();
+   }
+
+   // Nothing to process until now
+   current_tick = std::max(current_tick, now_tick);
+}
+
+template<typename id_t, typename hash_t>
+typename TimerWheel<id_t, hash_t>::timepoint TimerWheel<id_t, hash_t>::get_next_time() const
+{
+   uint64_t next_tick = get_next_tick();
+   return next_tick == NO_TICK ? timepoint::max() : to_time(next_tick);
+}
+
+template<typename id_t, typename hash_t>
+size_t TimerWheel<id_t, hash_t>::size() const
+{
+   return timers.size();
+}
+
+template<typename id_t, typename hash_t>
+uint64_t TimerWheel<id_t, hash_t>::get_next_tick() const
+{
+   if (timers.empty()) {
+      return NO_TICK;
+   }
+
+   for (int level = 0; level < LEVELS_COUNT; level++) {
+      int shift = SLOT_BITS * level;
+      size_t current_slot = (current_tick >> shift) & (SLOTS_COUNT - 1);
+      for (size_t i_slot = current_slot + 1; i_slot < SLOTS_COUNT; i_slot++) {
+         if (!slots[level][i_slot].empty()) {
+            uint64_t revolution_start = (current_tick >> (shift + SLOT_BITS)) << (shift + SLOT_BITS);
+            return revolution_start + (uint64_t(i_slot) << shift);
+         }
+      }
+   }
+
+   assert(!overflow.empty());
+   int overflow_shift = SLOT_BITS * LEVELS_COUNT;
+   return ((current_tick >> overflow_shift) + 1) << overflow_shift;
+}
+
+template<typename id_t, typename hash_t>
+uint64_t TimerWheel<id_t, hash_t>::to_tick(timepoint time) const
+{
+   if (time <= start) {
+      return 0;
+   }
+   // Rounded up, so timers never expire early
+   auto ticks = std::chrono::ceil<std::chrono::milliseconds>(time - start);
+   return static_cast<uint64_t>(ticks.count());
+}
+
+template<typename id_t, typename hash_t>
+typename TimerWheel<id_t, hash_t>::timepoint TimerWheel<id_t, hash_t>::to_time(uint64_t tick) const
+{
+   return start + std::chrono::duration_cast<timepoint::duration>(std::chrono::milliseconds(tick));
+}
+
+template<typename id_t, typename hash_t>
+void TimerWheel<id_t, hash_t>::place(const id_t& id, Timer& timer)
+{
+   assert(timer.tick >= current_tick);
+
+   timer.level = OVERFLOW_LEVEL;
+   timer.slot = 0;
+   for (int level = 0; level < LEVELS_COUNT; level++) {
+      if (((timer.tick ^ current_tick) >> (SLOT_BITS * (level + 1))) == 0) {
+         timer.level = level;
+         timer.slot = (timer.tick >> (SLOT_BITS * level)) & (SLOTS_COUNT - 1);
+         break;
+      }
+   }
+
+   Slot& slot = get_slot(timer.level, timer.slot);
+   timer.position = slot.insert(slot.end(), id);
+}
+
+template<typename id_t, typename hash_t>
+void TimerWheel<id_t, hash_t>::remove(const Timer& timer)
+{
+   get_slot(timer.level, timer.slot).erase(timer.position);
+}
+
+template<typename id_t, typename hash_t>
+typename TimerWheel<id_t, hash_t>::Slot& TimerWheel<id_t, hash_t>::get_slot(int level, size_t slot)
+{
+   return level == OVERFLOW_LEVEL ? overflow : slots[level][slot];
+}
+
+template<typename id_t, typename hash_t>
+void TimerWheel<id_t, hash_t>::cascade(int level, size_t slot)
+{
+   Slot moving;
+   moving.splice(moving.end(), get_slot(level, slot));
+   while (!moving.empty()) {
+      id_t id = std::move(moving.front());
+      moving.pop_front();
+      place(id, timers[id]);
+   }
+}
+
+template class TimerWheel<removal_target_t, removal_target_hash_t>;
+
+}
@@ -0,0 +1,84 @@
+#ifndef HKEYSTORE_TIMER_WHEEL_H
+#define HKEYSTORE_TIMER_WHEEL_H
+
+#include <array>
+#include <list>
+#include <vector>
+#include <chrono>
+#include <unordered_map>
+#include <functional>
+#include <cstdint>
+
+
+namespace hks {
+
+// Hierarchical timer wheel of ids with millisecond ticks
+//
+// Each level has 256 slots, a slot of a level covers all slots of the level below. Timers are placed at the lowest level
+// which has their tick within the current revolution and move down when the wheel reaches their slot.
+// Scheduling and cancelling take constant time. Not thread safe
+
+template<typename id_t, typename hash_t = std::hash<id_t>>
+class TimerWheel
+{
+public:
+   using timepoint = std::chrono::time_point<std::chrono::system_clock>;
+
+   explicit TimerWheel(timepoint now);
+
+   TimerWheel(const TimerWheel&) = delete;
+   void operator=(const TimerWheel&) = delete;
+
+   // Replaces the previous time of the id
+   void schedule(const id_t& id, timepoint time);
+   void cancel(const id_t& id);
+
+   // Moves ids with times up to now to expired
+   void advance(timepoint now, std::vector<id_t>& expired);
+
+   // Time when the wheel has to be advanced next, timepoint::max() if it's empty
+   timepoint get_next_time() const;
+
+   size_t size() const;
+
+private:
+   static const int SLOT_BITS = 8;
+   static const size_t SLOTS_COUNT = size_t(1) << SLOT_BITS;
+   static const int LEVELS_COUNT = 4;
+   // Timers after the last level revolution, placed again when the last level moves
+   static const int OVERFLOW_LEVEL = LEVELS_COUNT;
+
+   using Slot = std::list<id_t>;
+
+   struct Timer
+   {
+      uint64_t tick;
+      int level;
+      size_t slot;
+      typename Slot::iterator position;
+   };
+
+   static const uint64_t NO_TICK = uint64_t(-1);
+
+   // Next tick with timers to expire or to move to lower levels
+   uint64_t get_next_tick() const;
+   uint64_t to_tick(timepoint time) const;
+   timepoint to_time(uint64_t tick) const;
+
+   void place(const id_t& id, Timer& timer);
+   void remove(const Timer& timer);
+   Slot& get_slot(int level, size_t slot);
+   // Places timers of the slot again, they move to lower levels
+   void cascade(int level, size_t slot);
+
+   timepoint start;
+   // Last processed tick
+   uint64_t current_tick = 0;
+   std::array<std::array<Slot, SLOTS_COUNT>, LEVELS_COUNT> slots;
+   Slot overflow;
+   std::unordered_map<id_t, Timer, hash_t> timers;
+};
+
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef HKEYSTORE_TRACE_SCOPE_H
+#define HKEYSTORE_TRACE_SCOPE_H
+
+#include <atomic>
+
+#include <tracing.h>
+
+namespace hks {
+
+extern std::atomic<Tracer*> active_tracer;
+
+// Sends begin and end events of its scope to the active tracer.
+// Without a tracer, costs an atomic load and a branch
+class TraceScope
+{
+public:
+   explicit TraceScope(TraceEvent event, uint64_t node_id = 0, uint64_t record_id = 0, uint64_t size = 0)
+      : tracer(active_tracer.load(std::memory_order_acquire))
+   {
+      if (tracer) {
+         data.event = event;
+         data.node_id = node_id;
+         data.record_id = record_id;
+         data.size = size;
+         tracer->begin(data);
+      }
+   }
+
+   TraceScope(TraceEvent event, std::string_view path)
+      : tracer(active_tracer.load(std::memory_order_acquire))
+   {
+      if (tracer) {
+         data.event = event;
+         data.path = path;
+         tracer->begin(data);
+      }
+   }
+
+   ~TraceScope()
+   {
+      if (tracer) {
+         tracer->end(data);
+      }
+   }
+
+   TraceScope(const TraceScope&) = delete;
+   void operator=(const TraceScope&) = delete;
+
+   void set_node_id(uint64_t node_id) { data.node_id = node_id; }
+   void set_record_id(uint64_t record_id) { data.record_id = record_id; }
+   void set_size(uint64_t size) { data.size = size; }
+   void set_reused_record(bool reused_record) { data.reused_record = reused_record; }
+
+private:
+   Tracer* tracer;
+   TraceData data;
+};
+
+}
+
+#endif
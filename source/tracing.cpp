@@ -0,0 +1,12 @@
+#include "trace_scope.h"
+
+namespace hks {
+
+std::atomic<Tracer*> active_tracer = nullptr;
+
+void set_tracer(Tracer* tracer)
+{
+   active_tracer.store(tracer, std::memory_order_release);
+}
+
+}
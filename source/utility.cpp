@@ -3,12 +3,12 @@
 
 namespace hks {
 
-std::string find_next_sub_key(const std::string& path, size_t& pos)
+std::string_view find_next_sub_key(std::string_view path, size_t& pos)
 {
    size_t dot_offset = pos == 0 ? 0 : 1;
    size_t i_dot = path.find('.', pos + dot_offset);
-   std::string sub_key;
-   if (i_dot == std::string::npos) {
+   std::string_view sub_key;
+   if (i_dot == std::string_view::npos) {
       sub_key = path.substr(pos + dot_offset);
       pos = path.length();
    } else {
@@ -18,22 +18,22 @@ std::string find_next_sub_key(const std::string& path, size_t& pos)
    return sub_key;
 }
 
-std::string get_path_tail(const std::string& path, size_t pos)
+std::string_view get_path_tail(std::string_view path, size_t pos)
 {
    if (pos == 0) {
       return path;
    }
    if (pos == path.length()) {
-      return "";
+      return std::string_view();
    }
    assert(path[pos] == '.');
    return path.substr(pos + 1);
 }
 
-bool split_property_path(const std::string& property_path, std::string& node_path, std::string& property_name)
+bool split_property_path(std::string_view property_path, std::string_view& node_path, std::string_view& property_name)
 {
    size_t i_dot = property_path.find_last_of('.');
-   if (i_dot == std::string::npos) {
+   if (i_dot == std::string_view::npos) {
       return false;
    }
    node_path = property_path.substr(0, i_dot);
@@ -41,11 +41,11 @@ bool split_property_path(const std::string& property_path, std::string& node_pat
    return true;
 }
 
-void split_node_path(const std::string& node_path, std::string& parent_path, std::string& node_name)
+void split_node_path(std::string_view node_path, std::string_view& parent_path, std::string_view& node_name)
 {
    size_t i_dot = node_path.find_last_of('.');
-   if (i_dot == std::string::npos) {
-      parent_path = "";
+   if (i_dot == std::string_view::npos) {
+      parent_path = std::string_view();
       node_name = node_path;
    } else {
       parent_path = node_path.substr(0, i_dot);
@@ -53,4 +53,37 @@ void split_node_path(const std::string& node_path, std::string& parent_path, std
    }
 }
 
+const std::string& lookup_key(std::string_view key)
+{
+   thread_local std::string key_copy;
+   key_copy.assign(key.data(), key.size());
+   return key_copy;
+}
+
+uint64_t get_child_path_hash(uint64_t parent_path_hash, std::string_view name)
+{
+   uint64_t name_hash = std::hash<std::string_view>()(name);
+   return parent_path_hash ^ (name_hash + 0x9e3779b97f4a7c15ULL + (parent_path_hash << 6) + (parent_path_hash >> 2));
 }
+
+uint64_t get_path_hash(uint64_t base_path_hash, std::string_view path)
+{
+   uint64_t path_hash = base_path_hash;
+   size_t i_path = 0;
+   while (i_path < path.length()) {
+      path_hash = get_child_path_hash(path_hash, find_next_sub_key(path, i_path));
+   }
+   return path_hash;
+}
+
+uint64_t get_property_name_hash(std::string_view name)
+{
+   // FNV-1a
+   uint64_t hash = 0xcbf29ce484222325ULL;
+   for (char c : name) {
+      hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+   }
+   return hash == 0 ? 1 : hash;
+}
+
+}
\ No newline at end of file
@@ -1,18 +1,35 @@
 #ifndef HKEYSTORE_UTILITY_H
 #define HKEYSTORE_UTILITY_H
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <chrono>
 #include <type_traits>
 
 namespace hks {
 
-std::string find_next_sub_key(const std::string& path, size_t& pos);
+// Path parsing functions return views of the parsed path, so resolving a path doesn't allocate
 
-std::string get_path_tail(const std::string& path, size_t pos);
+std::string_view find_next_sub_key(std::string_view path, size_t& pos);
 
-bool split_property_path(const std::string& property_path, std::string& node_path, std::string& property_name);
-void split_node_path(const std::string& node_path, std::string& parent_path, std::string& node_name);
+std::string_view get_path_tail(std::string_view path, size_t pos);
+
+bool split_property_path(std::string_view property_path, std::string_view& node_path, std::string_view& property_name);
+void split_node_path(std::string_view node_path, std::string_view& parent_path, std::string_view& node_name);
+
+// Unordered maps can't be searched by std::string_view in C++ 17. Returns a per-thread copy of the key,
+// which reuses its buffer, so the lookups don't allocate. The copy is valid until the next call in the same thread
+const std::string& lookup_key(std::string_view key);
+
+// Hashes of node paths inside a volume. Path hash of a child is derived from the path hash of its parent,
+// so a node path hash is computed without its full path
+const uint64_t ROOT_PATH_HASH = 0;
+uint64_t get_child_path_hash(uint64_t parent_path_hash, std::string_view name);
+uint64_t get_path_hash(uint64_t base_path_hash, std::string_view path);
+
+// Stored in volumes, so it doesn't depend on the standard library. Never 0
+uint64_t get_property_name_hash(std::string_view name);
 
 class TypeConverter
 {
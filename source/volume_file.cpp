@@ -7,6 +7,8 @@
 #include <errors.h>
 
 #include "volume_file.h"
+#include "metrics_registry.h"
+#include "trace_scope.h"
 
 namespace hks {
 
@@ -25,7 +27,7 @@ struct RecordSizesInitializer {
 // From 32 bytes to 4 TB
 const std::array<size_t, VolumeFile::SIZES_COUNT> VolumeFile::RECORD_SIZES = RecordSizesInitializer().arr;
 
-static const int VERSION = 1;
+static const int VERSION = 7;
 static const char SIGNATURE[4] = { 'H', 'K', 'E', 'Y' };
 
 static const size_t EMPTY_OFFSET = size_t(-1);
@@ -51,8 +53,9 @@ void VolumeFile::create_new_volume_file(const std::string& path)
       header_block.free_records_block_offsets[i] = EMPTY_OFFSET;
    }
    header_block.available_free_records_block_offset = EMPTY_OFFSET;
-   header_block.root_node_record_id = record_id_t(-1);
+   header_block.root_node_id = node_id_t(-1);
    header_block.bplus_tree_record_id = record_id_t(-1);
+   header_block.node_records_table_record_id = record_id_t(-1);
    header_block.next_node_id = 0;
    memset(header_block.padding, 0, sizeof(header_block.padding));
    file.write(reinterpret_cast<char*>(&header_block), sizeof(HeaderBlock));
@@ -96,6 +99,8 @@ std::unique_ptr<VolumeFile> VolumeFile::open_volume_file(const std::string& path
 
 void VolumeFile::read_record(record_id_t record_id, std::function<void(std::istream&)> read) const
 {
+   ScopedTimer timer(Histogram::record_read);
+   TraceScope trace(TraceEvent::record_read, 0, record_id);
    lock_guard locker(lock);
 
    int i_size;
@@ -104,10 +109,13 @@ void VolumeFile::read_record(record_id_t record_id, std::function<void(std::istr
 
    file.seekg(offset);
    read(file);
+   metrics::increment(Counter::record_reads);
 }
 
 void VolumeFile::write_record(record_id_t record_id, const void* data, size_t size)
 {
+   ScopedTimer timer(Histogram::record_write);
+   TraceScope trace(TraceEvent::record_write, 0, record_id, size);
    lock_guard locker(lock);
 
    int i_size;
@@ -116,18 +124,35 @@ void VolumeFile::write_record(record_id_t record_id, const void* data, size_t si
 
    file.seekp(offset);
    file.write(reinterpret_cast<const char*>(data), size);
+   metrics::increment(Counter::record_writes);
 }
 
-record_id_t VolumeFile::get_root_node_record_id() const
+void VolumeFile::write_record(record_id_t record_id, size_t offset_in_record, const void* data, size_t size)
 {
+   ScopedTimer timer(Histogram::record_write);
+   TraceScope trace(TraceEvent::record_write, 0, record_id, size);
    lock_guard locker(lock);
-   return header_block.root_node_record_id;
+
+   int i_size;
+   size_t offset;
+   from_record_id(record_id, i_size, offset);
+   assert(offset_in_record + size <= RECORD_SIZES[i_size]);
+
+   file.seekp(offset + offset_in_record);
+   file.write(reinterpret_cast<const char*>(data), size);
+   metrics::increment(Counter::record_writes);
 }
 
-void VolumeFile::set_root_node_record_id(record_id_t root_node_record_id)
+node_id_t VolumeFile::get_root_node_id() const
 {
    lock_guard locker(lock);
-   header_block.root_node_record_id = root_node_record_id;
+   return header_block.root_node_id;
+}
+
+void VolumeFile::set_root_node_id(node_id_t root_node_id)
+{
+   lock_guard locker(lock);
+   header_block.root_node_id = root_node_id;
    save_header_block();
 }
 
@@ -144,6 +169,19 @@ void VolumeFile::set_bplus_tree_record_id(record_id_t bplus_tree_record_id)
    save_header_block();
 }
 
+record_id_t VolumeFile::get_node_records_table_record_id() const
+{
+   lock_guard locker(lock);
+   return header_block.node_records_table_record_id;
+}
+
+void VolumeFile::set_node_records_table_record_id(record_id_t node_records_table_record_id)
+{
+   lock_guard locker(lock);
+   header_block.node_records_table_record_id = node_records_table_record_id;
+   save_header_block();
+}
+
 node_id_t VolumeFile::allocate_next_node_id()
 {
    lock_guard locker(lock);
@@ -154,12 +192,15 @@ node_id_t VolumeFile::allocate_next_node_id()
 
 record_id_t VolumeFile::allocate_record(const void* data, size_t size)
 {
+   ScopedTimer timer(Histogram::record_allocation);
+   TraceScope trace(TraceEvent::record_allocation, 0, 0, size);
    lock_guard locker(lock);
 
    size_t offset = EMPTY_OFFSET;
 
    int i_size = find_best_fit_size(size);
-   if (header_block.free_records_block_offsets[i_size] != EMPTY_OFFSET) {
+   bool reused_record = header_block.free_records_block_offsets[i_size] != EMPTY_OFFSET;
+   if (reused_record) {
       // Can re-use free block
       for (int i = FREE_RECORDS_BLOCK_RECORDS_COUNT - 1; i >= 0; i--) {
          size_t& cur_node_offset = free_records_blocks[i_size].free_records_offsets[i];
@@ -191,12 +232,20 @@ record_id_t VolumeFile::allocate_record(const void* data, size_t size)
       write_padding(RECORD_SIZES[i_size] - size);
    }
 
-   return to_record_id(i_size, offset);
+   metrics::increment(Counter::record_allocations);
+   metrics::increment(Counter::record_writes);
+
+   record_id_t record_id = to_record_id(i_size, offset);
+   trace.set_record_id(record_id);
+   trace.set_reused_record(reused_record);
+   return record_id;
 }
 
 void VolumeFile::delete_record(record_id_t record_id)
 {
+   TraceScope trace(TraceEvent::record_deletion, 0, record_id);
    lock_guard locker(lock);
+   metrics::increment(Counter::record_deletions);
 
    int i_size;
    size_t offset;
@@ -232,14 +281,29 @@ record_id_t VolumeFile::resize_record(record_id_t record_id, const void* data, s
 
    if (i_new_size == i_current_size) {
       // leave node at the same place
+      ScopedTimer timer(Histogram::record_write);
+      TraceScope trace(TraceEvent::record_write, 0, record_id, size);
       file.seekp(offset);
       file.write(reinterpret_cast<const char*>(data), size);
+      metrics::increment(Counter::record_writes);
       return record_id;
    } 
 
    // move record to a new place
+   TraceScope trace(TraceEvent::record_relocation, 0, record_id, size);
+   metrics::increment(Counter::record_relocations);
    delete_record(record_id);
-   return allocate_record(data, size);
+   record_id_t new_record_id = allocate_record(data, size);
+   trace.set_record_id(new_record_id);
+   return new_record_id;
+}
+
+size_t VolumeFile::get_record_offset(record_id_t record_id)
+{
+   int i_size;
+   size_t offset;
+   from_record_id(record_id, i_size, offset);
+   return offset;
 }
 
 int VolumeFile::find_best_fit_size(size_t node_size)
@@ -34,19 +34,25 @@ public:
 
    void read_record(record_id_t record_id, std::function<void(std::istream&)> read) const;
    void write_record(record_id_t record_id, const void* data, size_t size);
+   void write_record(record_id_t record_id, size_t offset, const void* data, size_t size);
 
-   record_id_t get_root_node_record_id() const;
-   void set_root_node_record_id(record_id_t root_node_record_id);
+   node_id_t get_root_node_id() const;
+   void set_root_node_id(node_id_t root_node_id);
 
    record_id_t get_bplus_tree_record_id() const;
    void set_bplus_tree_record_id(record_id_t bplus_tree_record_id);
 
+   record_id_t get_node_records_table_record_id() const;
+   void set_node_records_table_record_id(record_id_t node_records_table_record_id);
+
    node_id_t allocate_next_node_id();
 
    record_id_t allocate_record(const void* data, size_t size);
    void delete_record(record_id_t record_id);
    record_id_t resize_record(record_id_t record_id, const void* data, size_t size);
 
+   static size_t get_record_offset(record_id_t record_id);
+
 private:
    static const int CONTROL_BLOCK_SIZE = 4096;
    static const int FREE_RECORDS_BLOCK_RECORDS_COUNT = CONTROL_BLOCK_SIZE / sizeof(size_t) - 1;
@@ -57,10 +63,11 @@ private:
       int32_t version;
       size_t free_records_block_offsets[SIZES_COUNT];
       size_t available_free_records_block_offset;
-      record_id_t root_node_record_id;
+      node_id_t root_node_id;
       record_id_t bplus_tree_record_id;
+      record_id_t node_records_table_record_id;
       node_id_t next_node_id;
-      char padding[CONTROL_BLOCK_SIZE - 4 - sizeof(int32_t) - SIZES_COUNT * sizeof(size_t) - sizeof(size_t) - 2 * sizeof(record_id_t) - sizeof(node_id_t)];
+      char padding[CONTROL_BLOCK_SIZE - 4 - sizeof(int32_t) - SIZES_COUNT * sizeof(size_t) - sizeof(size_t) - 2 * sizeof(record_id_t) - 2 * sizeof(node_id_t)];
    };
 
    static_assert(sizeof(HeaderBlock) == CONTROL_BLOCK_SIZE);
@@ -1,4 +1,5 @@
 #include <cassert>
+#include <algorithm>
 
 #include "volume_impl.h"
 #include "node_impl.h"
@@ -6,26 +7,73 @@
 
 namespace hks {
 
-VolumeImpl::VolumeImpl(const std::string& volume_file_path, bool create_if_not_exist)
+VolumeImpl::VolumeImpl(const std::string& volume_file_path, bool create_if_not_exist, const VolumeOptions& options)
 {
+   if (options.write_back) {
+      node_flusher = std::make_unique<NodeFlusher>(options.flush_interval, options.max_dirty_bytes);
+   }
+   if (options.node_cache_size > 0) {
+      node_cache = std::make_unique<NodeCache>(options.node_cache_size);
+   }
+
    if (create_if_not_exist) {
       if (!VolumeFile::volume_file_exists(volume_file_path)) {
          // Create new volume
          VolumeFile::create_new_volume_file(volume_file_path);
          volume_file = VolumeFile::open_volume_file(volume_file_path);
+         node_records_table = std::make_unique<NodeRecordsTable>(volume_file);
          root = std::make_shared<NodeImpl>(nullptr, this);
+         volume_file->set_root_node_id(root->get_node_id());
          std::unique_ptr<NodesToRemoveTree> nodes_to_remove_tree = std::make_unique<NodesToRemoveTree>(volume_file);
          volume_file->set_bplus_tree_record_id(nodes_to_remove_tree->get_record_id());
          time_to_live_manager = std::make_unique<TimeToLiveManager>(std::move(nodes_to_remove_tree), this);
+         time_to_live_manager->start();
          return;
       }
    }
 
    // Open existing volume
    volume_file = VolumeFile::open_volume_file(volume_file_path);
-   root = std::make_shared<NodeImpl>(nullptr, this, volume_file->get_root_node_record_id());
+   node_records_table = std::make_unique<NodeRecordsTable>(volume_file, volume_file->get_node_records_table_record_id());
+   root = std::make_shared<NodeImpl>(nullptr, this, volume_file->get_root_node_id());
    std::unique_ptr<NodesToRemoveTree> nodes_to_remove_tree = std::make_unique<NodesToRemoveTree>(volume_file, volume_file->get_bplus_tree_record_id());
    time_to_live_manager = std::make_unique<TimeToLiveManager>(std::move(nodes_to_remove_tree), this);
+   delete_orphan_nodes();
+   time_to_live_manager->start();
+}
+
+VolumeImpl::~VolumeImpl()
+{
+   // Stop removing nodes first, then write all changed nodes
+   time_to_live_manager->stop();
+   time_to_live_manager.reset();
+   node_flusher.reset();
+   node_cache.reset();
+}
+
+void VolumeImpl::flush()
+{
+   time_to_live_manager->flush();
+   if (node_flusher) {
+      node_flusher->flush();
+   }
+}
+
+void VolumeImpl::delete_orphan_nodes()
+{
+   // Subtrees, which were being deleted when the process stopped, are finished before the volume is used.
+   // Path filter isn't enabled yet, so paths of these nodes aren't needed
+   for (node_id_t node_id : node_records_table->get_orphan_node_ids(root->get_node_id())) {
+      std::make_shared<NodeImpl>(nullptr, this, node_id)->delete_from_volume();
+   }
+}
+
+NodeCacheStatistics VolumeImpl::get_node_cache_statistics() const
+{
+   if (!node_cache) {
+      return NodeCacheStatistics();
+   }
+   return node_cache->get_statistics();
 }
 
 void VolumeImpl::set_storage(Storage* storage)
@@ -38,6 +86,14 @@ Storage* VolumeImpl::get_storage()
    return storage;
 }
 
+void VolumeImpl::node_names_added()
+{
+   Storage* storage = this->storage;
+   if (storage) {
+      storage->node_names_added();
+   }
+}
+
 TimeToLiveManager* VolumeImpl::get_time_to_live_manager()
 {
    return time_to_live_manager.get();
@@ -48,13 +104,46 @@ std::shared_ptr<VolumeFile> VolumeImpl::get_volume_file()
    return volume_file;
 }
 
-std::shared_ptr<NodeImpl> VolumeImpl::get_node(const std::string& path)
+NodeRecordsTable* VolumeImpl::get_node_records_table()
+{
+   return node_records_table.get();
+}
+
+NodeFlusher* VolumeImpl::get_node_flusher()
+{
+   return node_flusher.get();
+}
+
+NodeCache* VolumeImpl::get_node_cache()
+{
+   return node_cache.get();
+}
+
+PathFilter& VolumeImpl::get_path_filter()
+{
+   return path_filter;
+}
+
+void VolumeImpl::enable_path_filter()
+{
+   if (path_filter.enable()) {
+      root->add_path_hashes(path_filter);
+      path_filter.set_ready();
+   }
+}
+
+bool VolumeImpl::might_contain(uint64_t base_path_hash, std::string_view path) const
+{
+   return path_filter.might_contain(get_path_hash(base_path_hash, path));
+}
+
+std::shared_ptr<NodeImpl> VolumeImpl::get_node(std::string_view path)
 {
    std::shared_ptr<NodeImpl> node = root;
 
    size_t i_path = 0;
    while (i_path < path.length()) {
-      std::string sub_key = find_next_sub_key(path, i_path);
+      std::string_view sub_key = find_next_sub_key(path, i_path);
       node = node->get_child_impl(sub_key);
       if (node == nullptr) {
          return nullptr;
@@ -64,19 +153,35 @@ std::shared_ptr<NodeImpl> VolumeImpl::get_node(const std::string& path)
    return node;
 }
 
-bool VolumeImpl::remove_node(const std::vector<node_id_t>& path_to_remove)
+std::shared_ptr<NodeImpl> VolumeImpl::get_node(const std::vector<node_id_t>& unique_node_path)
 {
-   assert(root->get_node_id() == path_to_remove[0]);
+   assert(root->get_node_id() == unique_node_path[0]);
    std::shared_ptr<NodeImpl> node = root;
 
-   for (size_t i = 1; i < path_to_remove.size() - 1; i++) {
-      node = node->get_child_impl(path_to_remove[i]);
+   for (size_t i = 1; i < unique_node_path.size(); i++) {
+      node = node->get_child_impl(unique_node_path[i]);
       if (node == nullptr) {
-         return false;
+         return nullptr;
+      }
+   }
+
+   return node;
+}
+
+std::shared_ptr<NodeImpl> VolumeImpl::get_node_by_id(node_id_t node_id)
+{
+   std::vector<node_id_t> unique_node_path{ node_id };
+   while (unique_node_path.back() != root->get_node_id()) {
+      node_id_t parent_node_id = node_records_table->get_parent_node_id(unique_node_path.back());
+      if (parent_node_id == NodeRecordsTable::NO_NODE_ID) {
+         // Node was removed
+         return nullptr;
       }
+      unique_node_path.push_back(parent_node_id);
    }
 
-   return node->remove_child_impl(path_to_remove[path_to_remove.size() - 1]);
+   std::reverse(unique_node_path.begin(), unique_node_path.end());
+   return get_node(unique_node_path);
 }
 
 }
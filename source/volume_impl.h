@@ -2,37 +2,66 @@
 #define HKEYSTORE_VOLUME_IMPL_H
 
 #include <memory>
+#include <atomic>
 
 #include <storage.h>
 
 #include "node_impl.h"
 #include "time_to_live_manager.h"
 #include "bplus_tree.h"
+#include "node_records_table.h"
+#include "node_flusher.h"
+#include "node_cache.h"
+#include "path_filter.h"
 
 namespace hks {
 
 class VolumeImpl : public Volume
 {
 public:
-   VolumeImpl(const std::string& volume_file_path, bool create_if_not_exist);
+   VolumeImpl(const std::string& volume_file_path, bool create_if_not_exist, const VolumeOptions& options);
+   ~VolumeImpl();
+
+   void flush() override;
+   NodeCacheStatistics get_node_cache_statistics() const override;
 
    void set_storage(Storage* storage);
    Storage* get_storage();
+   // Lets the storage drop cached paths which added or renamed nodes could shadow
+   void node_names_added();
 
    TimeToLiveManager* get_time_to_live_manager();
    std::shared_ptr<VolumeFile> get_volume_file();
+   NodeRecordsTable* get_node_records_table();
+   NodeFlusher* get_node_flusher();
+   NodeCache* get_node_cache();
+   PathFilter& get_path_filter();
+
+   // Builds the path filter, after that lookups can skip the volume when it has no node with the path
+   void enable_path_filter();
+   bool might_contain(uint64_t base_path_hash, std::string_view path) const;
 
-   std::shared_ptr<NodeImpl> get_node(const std::string& path);
-   bool remove_node(const std::vector<node_id_t>& path_to_remove);
+   std::shared_ptr<NodeImpl> get_node(std::string_view path);
+   // Finds node by node ids of the path from the root
+   std::shared_ptr<NodeImpl> get_node(const std::vector<node_id_t>& unique_node_path);
+   // Finds node by its id through the parent ids in the node records table
+   std::shared_ptr<NodeImpl> get_node_by_id(node_id_t node_id);
 
 private:
    using NodesToRemoveTree = TimeToLiveManager::NodesToRemoveTree;
 
-   Storage* storage = nullptr;
+   // Deletes subtrees left by a crash while they were deleted
+   void delete_orphan_nodes();
+
+   std::atomic<Storage*> storage = nullptr;
 
    std::shared_ptr<NodeImpl> root;
    std::unique_ptr<TimeToLiveManager> time_to_live_manager;
    std::shared_ptr<VolumeFile> volume_file;
+   std::unique_ptr<NodeRecordsTable> node_records_table;
+   std::unique_ptr<NodeFlusher> node_flusher;
+   std::unique_ptr<NodeCache> node_cache;
+   PathFilter path_filter;
 };
 
 }
@@ -0,0 +1,59 @@
+#include "storage.h"
+#include "node.h"
+#include "batch.h"
+#include "errors.h"
+
+using namespace hks;
+
+BOOST_AUTO_TEST_SUITE(async_tests)
+
+BOOST_AUTO_TEST_CASE(test_async_calls)
+{
+   remove("volume");
+   StorageOptions options;
+   options.async_threads_count = 2;
+   auto storage = std::make_unique<Storage>(options);
+   auto volume = storage->open_volume("volume", true);
+   storage->mount(volume, "");
+
+   BOOST_CHECK(storage->add_node_async("", "node1").get() != nullptr);
+   BOOST_CHECK(storage->set_property_async("node1.int", 1).get());
+   BOOST_CHECK(!storage->set_property_async("node2.int", 1).get());
+
+   std::vector<std::future<bool>> futures;
+   for (int i = 0; i < 100; i++) {
+      futures.push_back(storage->set_property_async("node1.property" + std::to_string(i), std::string("value") + std::to_string(i)));
+   }
+   for (auto& future : futures) {
+      BOOST_CHECK(future.get());
+   }
+
+   std::optional<Value> value = storage->get_property_async("node1.property10").get();
+   BOOST_CHECK(value == Value(std::string("value10")));
+   BOOST_CHECK(!storage->get_property_async("node1.missing").get());
+
+   Batch batch;
+   batch.add_node("node1", "node2");
+   batch.set_property("node1.node2.int", 2);
+   storage->apply_async(batch).get();
+   BOOST_CHECK(storage->get_node_async("node1.node2").get() != nullptr);
+
+   storage->rename_node_async("node1.node2", "node3").get();
+   BOOST_CHECK(storage->remove_property_async("node1.node3.int").get());
+   storage->remove_node_async("node1.node3").get();
+   BOOST_CHECK(storage->get_node("node1.node3") == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(test_async_errors)
+{
+   remove("volume");
+   auto storage = std::make_unique<Storage>();
+   auto volume = storage->open_volume("volume", true);
+   storage->mount(volume, "");
+
+   BOOST_CHECK_THROW(storage->add_node_async("node1", "node2").get(), Exception);
+   BOOST_CHECK_THROW(storage->remove_node_async("node1").get(), Exception);
+   BOOST_CHECK_THROW(storage->get_property_async("property").get(), Exception);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,175 @@
+#include "storage.h"
+#include "node.h"
+#include "batch.h"
+#include "errors.h"
+
+using namespace hks;
+
+BOOST_AUTO_TEST_SUITE(batch_tests)
+
+BOOST_AUTO_TEST_CASE(test_storage_batch)
+{
+   remove("volume");
+   auto storage = std::make_unique<Storage>();
+   auto volume = storage->open_volume("volume", true);
+   storage->mount(volume, "");
+
+   storage->add_node("", "node1");
+   storage->set_property("node1.removed", 1);
+
+   std::vector<char> data(100, 'a');
+
+   Batch batch;
+   batch.add_node("node1", "node2");
+   batch.add_node("", "node3");
+   batch.set_property("node1.int", 5);
+   batch.set_property("node1.string", std::string("abc"));
+   batch.set_property("node1.node2.blob", data);
+   batch.set_property("node3.double", 2.5);
+   batch.remove_property("node1.removed");
+   storage->apply(batch);
+
+   int i_value;
+   BOOST_CHECK(storage->get_property("node1.int", i_value));
+   BOOST_CHECK(i_value == 5);
+   std::string s_value;
+   BOOST_CHECK(storage->get_property("node1.string", s_value));
+   BOOST_CHECK(s_value == "abc");
+   std::vector<char> blob;
+   BOOST_CHECK(storage->get_property("node1.node2.blob", blob));
+   BOOST_CHECK(blob == data);
+   double d_value;
+   BOOST_CHECK(storage->get_property("node3.double", d_value));
+   BOOST_CHECK(d_value == 2.5);
+   BOOST_CHECK(!storage->get_property("node1.removed", i_value));
+}
+
+BOOST_AUTO_TEST_CASE(test_node_batch)
+{
+   remove("volume");
+   auto storage = std::make_unique<Storage>();
+   auto volume = storage->open_volume("volume", true);
+   storage->mount(volume, "");
+
+   auto node1 = storage->add_node("", "node1");
+
+   Batch batch;
+   batch.add_node("", "node2");
+   batch.set_property("int", 1);
+   batch.set_property("node2.int", 2);
+   node1->apply(batch);
+
+   int value;
+   BOOST_CHECK(storage->get_property("node1.int", value));
+   BOOST_CHECK(value == 1);
+   BOOST_CHECK(storage->get_property("node1.node2.int", value));
+   BOOST_CHECK(value == 2);
+}
+
+BOOST_AUTO_TEST_CASE(test_batch_error)
+{
+   remove("volume");
+   auto storage = std::make_unique<Storage>();
+   auto volume = storage->open_volume("volume", true);
+   storage->mount(volume, "");
+
+   storage->add_node("", "node1");
+
+   Batch missing_node_batch;
+   missing_node_batch.set_property("node1.int", 1);
+   missing_node_batch.set_property("node2.int", 2);
+   BOOST_CHECK_THROW(storage->apply(missing_node_batch), Exception);
+
+   // Nothing is changed, if a node is missing
+   int value;
+   BOOST_CHECK(!storage->get_property("node1.int", value));
+
+   Batch existing_node_batch;
+   existing_node_batch.add_node("", "node1");
+   BOOST_CHECK_THROW(storage->apply(existing_node_batch), Exception);
+
+   Batch invalid_path_batch;
+   invalid_path_batch.set_property("int", 1);
+   BOOST_CHECK_THROW(storage->apply(invalid_path_batch), Exception);
+}
+
+BOOST_AUTO_TEST_CASE(test_batch_atomicity)
+{
+   remove("volume");
+   auto storage = std::make_unique<Storage>();
+   auto volume = storage->open_volume("volume", true);
+   storage->mount(volume, "");
+
+   storage->add_node("", "node1");
+   storage->add_node("", "node2");
+
+   // Nodes of other parents are not added, if one of them already exists
+   Batch existing_node_batch;
+   existing_node_batch.add_node("", "node3");
+   existing_node_batch.add_node("node2", "node4");
+   existing_node_batch.add_node("", "node1");
+   BOOST_CHECK_THROW(storage->apply(existing_node_batch), NodeAlreadyExists);
+   BOOST_CHECK(storage->get_node("node3") == nullptr);
+   BOOST_CHECK(storage->get_node("node2.node4") == nullptr);
+
+   // Nodes are not added, if a changed node is missing
+   Batch missing_node_batch;
+   missing_node_batch.add_node("node1", "node3");
+   missing_node_batch.set_property("node5.int", 1);
+   BOOST_CHECK_THROW(storage->apply(missing_node_batch), NoSuchNode);
+   BOOST_CHECK(storage->get_node("node1.node3") == nullptr);
+
+   // Names are checked before anything is added
+   Batch invalid_name_batch;
+   invalid_name_batch.add_node("node1", "node3");
+   invalid_name_batch.add_node("node2", "node.4");
+   invalid_name_batch.set_property("node1.int", 1);
+   BOOST_CHECK_THROW(storage->apply(invalid_name_batch), LogicError);
+   BOOST_CHECK(storage->get_node("node1.node3") == nullptr);
+   int value;
+   BOOST_CHECK(!storage->get_property("node1.int", value));
+
+   Batch duplicate_node_batch;
+   duplicate_node_batch.add_node("node1", "node3");
+   duplicate_node_batch.add_node("node1", "node3");
+   BOOST_CHECK_THROW(storage->apply(duplicate_node_batch), NodeAlreadyExists);
+   BOOST_CHECK(storage->get_node("node1.node3") == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(test_batch_nested_nodes)
+{
+   remove("volume");
+   auto storage = std::make_unique<Storage>();
+   auto volume = storage->open_volume("volume", true);
+   storage->mount(volume, "");
+
+   // Added nodes are parents of other added nodes
+   Batch batch;
+   batch.add_node("node1.node2", "node3");
+   batch.add_node("", "node1");
+   batch.add_node("node1", "node2");
+   batch.set_property("node1.node2.node3.int", 3);
+   storage->apply(batch);
+
+   int value;
+   BOOST_CHECK(storage->get_property("node1.node2.node3.int", value));
+   BOOST_CHECK(value == 3);
+
+   auto node1 = storage->get_node("node1");
+   Batch node_batch;
+   node_batch.add_node("node4", "node5");
+   node_batch.add_node("", "node4");
+   node_batch.set_property("node4.node5.int", 5);
+   node1->apply(node_batch);
+   BOOST_CHECK(storage->get_property("node1.node4.node5.int", value));
+   BOOST_CHECK(value == 5);
+
+   // Parent which is neither added nor existing fails the batch
+   Batch missing_parent_batch;
+   missing_parent_batch.add_node("node6", "node7");
+   missing_parent_batch.add_node("", "node8");
+   BOOST_CHECK_THROW(storage->apply(missing_parent_batch), NoSuchNode);
+   BOOST_CHECK(storage->get_node("node8") == nullptr);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,6 +2,9 @@
 #include "node.h"
 #include "errors.h"
 #include <fstream>
+#include <thread>
+#include <atomic>
+#include <chrono>
 
 using namespace hks;
 
@@ -53,4 +56,121 @@ BOOST_AUTO_TEST_CASE(test_a_lot_of_keys)
    BOOST_TEST_MESSAGE("Volume size is " << get_file_size("volume") << " bytes");
 }
 
+BOOST_AUTO_TEST_CASE(test_root_node_contention)
+{
+   remove("volume");
+   auto storage = std::make_unique<Storage>();
+   auto volume = storage->open_volume("volume", true);
+   storage->mount(volume, "");
+
+   const int NODES_COUNT = 10;
+   const int READS_COUNT = 100000;
+
+   std::vector<std::shared_ptr<Node>> nodes;
+   for (int i = 0; i < NODES_COUNT; i++) {
+      nodes.push_back(storage->add_node("", "node" + std::to_string(i)));
+      nodes.back()->set_property("property", i);
+   }
+
+   for (unsigned threads_count = 1; threads_count <= std::max(4U, std::thread::hardware_concurrency()); threads_count *= 2) {
+      auto start = std::chrono::steady_clock::now();
+
+      std::vector<std::thread> threads;
+      for (unsigned i_thread = 0; i_thread < threads_count; i_thread++) {
+         threads.emplace_back([&, i_thread]() {
+            // Every lookup passes through the root node
+            for (int i = 0; i < READS_COUNT; i++) {
+               int value;
+               storage->get_property("node" + std::to_string((i + i_thread) % NODES_COUNT) + ".property", value);
+            }
+         });
+      }
+      for (auto& thread : threads) {
+         thread.join();
+      }
+
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      BOOST_TEST_MESSAGE(threads_count << " threads: " << static_cast<int64_t>(threads_count * READS_COUNT / elapsed.count()) << " reads per second");
+   }
+}
+
+BOOST_AUTO_TEST_CASE(test_mount_while_reading)
+{
+   remove("volume");
+   remove("volume2");
+   auto storage = std::make_unique<Storage>();
+   auto volume = storage->open_volume("volume", true);
+   auto volume2 = storage->open_volume("volume2", true);
+   storage->mount(volume, "");
+   storage->add_node("", "node");
+   storage->set_property("node.property", 1);
+
+   std::atomic<bool> stop = false;
+   std::atomic<bool> failed = false;
+   std::vector<std::thread> threads;
+   for (unsigned i_thread = 0; i_thread < 4; i_thread++) {
+      threads.emplace_back([&]() {
+         while (!stop) {
+            int value;
+            if (!storage->get_property("node.property", value) || value != 1) {
+               failed = true;
+            }
+         }
+      });
+   }
+
+   // Lookups keep going through the old mount tree while a new one is published
+   for (int i = 0; i < 100; i++) {
+      storage->mount(volume2, "other");
+      storage->unmount(volume2, "other");
+   }
+
+   stop = true;
+   for (auto& thread : threads) {
+      thread.join();
+   }
+   BOOST_CHECK(!failed);
+}
+
+BOOST_AUTO_TEST_CASE(test_multiple_properties_performance)
+{
+   remove("volume");
+   auto storage = std::make_unique<Storage>();
+   auto volume = storage->open_volume("volume", true);
+   storage->mount(volume, "");
+
+   const int NODES_COUNT = 20;
+   const int NODE_PROPERTIES_COUNT = 10;
+   const int REQUESTS_COUNT = 2000;
+
+   std::vector<std::string> paths;
+   for (int i = 0; i < NODES_COUNT; i++) {
+      auto node = storage->add_node("", "node" + std::to_string(i))->add_child("child");
+      for (int j = 0; j < NODE_PROPERTIES_COUNT; j++) {
+         node->set_property("property" + std::to_string(j), j);
+         paths.push_back("node" + std::to_string(i) + ".child.property" + std::to_string(j));
+      }
+   }
+
+   auto start = std::chrono::steady_clock::now();
+   for (int i = 0; i < REQUESTS_COUNT; i++) {
+      for (auto& path : paths) {
+         int value;
+         storage->get_property(path, value);
+      }
+   }
+   auto single_time = std::chrono::steady_clock::now() - start;
+
+   start = std::chrono::steady_clock::now();
+   for (int i = 0; i < REQUESTS_COUNT; i++) {
+      std::vector<std::optional<Value>> values = storage->get_properties(paths);
+      BOOST_REQUIRE(values.size() == paths.size());
+   }
+   auto multiple_time = std::chrono::steady_clock::now() - start;
+
+   BOOST_TEST_MESSAGE("Reading " << paths.size() << " properties: "
+      << std::chrono::duration_cast<std::chrono::microseconds>(single_time).count() / REQUESTS_COUNT << " us by get_property, "
+      << std::chrono::duration_cast<std::chrono::microseconds>(multiple_time).count() / REQUESTS_COUNT << " us by get_properties");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
@@ -5,4 +5,8 @@
 #include "properties_tests.hpp"
 #include "persistance_tests.hpp"
 #include "time_to_live_tests.hpp"
+#include "batch_tests.hpp"
+#include "async_tests.hpp"
 #include "load_tests.hpp"
+#include "metrics_tests.hpp"
+#include "tracing_tests.hpp"
@@ -0,0 +1,100 @@
+#include <thread>
+#include <vector>
+
+#include "storage.h"
+#include "node.h"
+#include "metrics.h"
+
+using namespace hks;
+
+BOOST_AUTO_TEST_SUITE(metrics_tests)
+
+BOOST_AUTO_TEST_CASE(test_storage_metrics)
+{
+   remove("volume");
+   auto storage = std::make_unique<Storage>();
+   auto volume = storage->open_volume("volume", true);
+   storage->mount(volume, "");
+
+   MetricsSnapshot before = get_metrics();
+   storage->add_node("", "node1");
+   storage->set_property("node1.property", 1);
+   int value;
+   BOOST_CHECK(storage->get_property("node1.property", value));
+   BOOST_CHECK(!storage->get_property("node2.property", value));
+   MetricsSnapshot after = get_metrics();
+
+   BOOST_CHECK(after.histograms["storage.add_node"].count == before.histograms["storage.add_node"].count + 1);
+   BOOST_CHECK(after.histograms["storage.set_property"].count == before.histograms["storage.set_property"].count + 1);
+   BOOST_CHECK(after.histograms["storage.get_property"].count == before.histograms["storage.get_property"].count + 2);
+
+   const HistogramSnapshot& get_property = after.histograms["storage.get_property"];
+   BOOST_CHECK(get_property.p50 <= get_property.p99);
+   BOOST_CHECK(get_property.p99 <= get_property.max);
+   BOOST_CHECK(get_property.max <= get_property.total);
+}
+
+BOOST_AUTO_TEST_CASE(test_volume_file_metrics)
+{
+   remove("volume");
+   auto storage = std::make_unique<Storage>();
+   // Mounting again drops nodes resolved by storage, so with the small node cache they are loaded again
+   VolumeOptions options;
+   options.node_cache_size = 1;
+   auto volume = storage->open_volume("volume", true, options);
+   storage->mount(volume, "");
+
+   MetricsSnapshot before = get_metrics();
+   storage->add_node("", "node1");
+   storage->set_property("node1.property", 1);
+   storage->unmount(volume, "");
+   storage->mount(volume, "");
+   int value;
+   BOOST_CHECK(storage->get_property("node1.property", value));
+   MetricsSnapshot after = get_metrics();
+
+   BOOST_CHECK(after.counters["node_saves"] > before.counters["node_saves"]);
+   BOOST_CHECK(after.counters["node_loads"] > before.counters["node_loads"]);
+   BOOST_CHECK(after.counters["record_allocations"] > before.counters["record_allocations"]);
+   BOOST_CHECK(after.counters["record_writes"] > before.counters["record_writes"]);
+   BOOST_CHECK(after.counters["record_reads"] > before.counters["record_reads"]);
+
+   BOOST_CHECK(after.histograms["node.save"].count > before.histograms["node.save"].count);
+   BOOST_CHECK(after.histograms["node.load"].count > before.histograms["node.load"].count);
+   BOOST_CHECK(after.histograms["volume_file.allocate_record"].count > before.histograms["volume_file.allocate_record"].count);
+   BOOST_CHECK(after.histograms["volume_file.write_record"].count > before.histograms["volume_file.write_record"].count);
+   BOOST_CHECK(after.histograms["volume_file.read_record"].count > before.histograms["volume_file.read_record"].count);
+}
+
+BOOST_AUTO_TEST_CASE(test_metrics_of_exited_threads)
+{
+   const int THREADS_COUNT = 8;
+   const int CALLS_COUNT = 100;
+
+   remove("volume");
+   auto storage = std::make_unique<Storage>();
+   auto volume = storage->open_volume("volume", true);
+   storage->mount(volume, "");
+   storage->add_node("", "node1");
+
+   MetricsSnapshot before = get_metrics();
+   std::vector<std::thread> threads;
+   for (int i = 0; i < THREADS_COUNT; i++) {
+      threads.emplace_back([&]() {
+         for (int i_call = 0; i_call < CALLS_COUNT; i_call++) {
+            storage->get_node("node1");
+         }
+      });
+   }
+   for (auto& thread : threads) {
+      thread.join();
+   }
+   MetricsSnapshot after = get_metrics();
+
+   // Shards of the exited threads are freed, their metrics stay
+   const HistogramSnapshot& get_node = after.histograms["storage.get_node"];
+   BOOST_CHECK(get_node.count == before.histograms["storage.get_node"].count + THREADS_COUNT * CALLS_COUNT);
+   BOOST_CHECK(get_node.max <= get_node.total);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,5 +1,6 @@
 #include "storage.h"
 #include "node.h"
+#include "property_handle.h"
 #include "errors.h"
 
 using namespace hks;
@@ -89,6 +90,9 @@ BOOST_AUTO_TEST_CASE(test_remove_node)
    BOOST_CHECK(!node1->is_deleted());
    BOOST_CHECK(node2->is_deleted());
    BOOST_CHECK(node3->is_deleted());
+
+   // Deleted node still returns its loaded children
+   BOOST_CHECK(node2->get_child("node3") == node3);
 }
 
 BOOST_AUTO_TEST_CASE(test_remove_node_error)
@@ -105,4 +109,97 @@ BOOST_AUTO_TEST_CASE(test_remove_node_error)
    BOOST_CHECK_THROW(storage->remove_node("node1.node2.node3"), Exception);
 }
 
+BOOST_AUTO_TEST_CASE(test_cached_paths)
+{
+   remove("volume");
+   remove("volume2");
+   auto storage = std::make_unique<Storage>();
+   auto volume = storage->open_volume("volume", true);
+   storage->mount(volume, "");
+
+   storage->add_node("", "node1");
+   storage->add_node("node1", "node2");
+   BOOST_CHECK(storage->set_property("node1.node2.prop", 1));
+
+   int value = 0;
+   BOOST_CHECK(storage->get_property("node1.node2.prop", value));
+   storage->rename_node("node1", "renamed");
+   BOOST_CHECK(!storage->get_property("node1.node2.prop", value));
+   BOOST_CHECK(storage->get_property("renamed.node2.prop", value));
+
+   storage->remove_node("renamed.node2");
+   BOOST_CHECK(!storage->get_property("renamed.node2.prop", value));
+   storage->add_node("renamed", "node2");
+   BOOST_CHECK(!storage->get_property("renamed.node2.prop", value));
+
+   // Renaming or removing a node invalidates cached paths and handles of its subtree
+   storage->add_node("", "node4");
+   storage->add_node("node4", "node5");
+   BOOST_CHECK(storage->set_property("node4.node5.prop", 5));
+   auto handle = storage->prepare("node4.node5.prop");
+   BOOST_CHECK(handle->get(value) && value == 5);
+   storage->rename_node("renamed", "node6");
+   BOOST_CHECK(handle->get(value) && value == 5);
+   storage->rename_node("node4", "node7");
+   BOOST_CHECK(!handle->get(value));
+   BOOST_CHECK(!storage->get_property("node4.node5.prop", value));
+   BOOST_CHECK(storage->get_property("node7.node5.prop", value) && value == 5);
+   storage->remove_node("node7");
+   BOOST_CHECK(!storage->get_property("node7.node5.prop", value));
+
+   // Node added to the volume mounted above shadows the cached node of the nested volume
+   auto volume2 = storage->open_volume("volume2", true);
+   storage->mount(volume2, "other");
+   storage->add_node("other", "node3");
+   BOOST_CHECK(storage->set_property("other.node3.prop", 1));
+   BOOST_CHECK(storage->get_property("other.node3.prop", value));
+   storage->add_node("", "other");
+   storage->add_node("other", "node3");
+   BOOST_CHECK(!storage->get_property("other.node3.prop", value));
+
+   storage->remove_node("other");
+   BOOST_CHECK(storage->get_property("other.node3.prop", value));
+   storage->unmount(volume2, "other");
+   BOOST_CHECK(!storage->get_property("other.node3.prop", value));
+}
+
+BOOST_AUTO_TEST_CASE(test_stacked_volumes_lookup)
+{
+   remove("volume");
+   remove("volume2");
+   {
+      auto storage = std::make_unique<Storage>();
+      auto volume = storage->open_volume("volume", true);
+      auto volume2 = storage->open_volume("volume2", true);
+      storage->mount(volume, "");
+      storage->add_node("", "node1");
+      storage->add_node("node1", "node3");
+      storage->unmount(volume, "");
+
+      storage->mount(volume2, "");
+      storage->add_node("", "node1");
+      storage->add_node("node1", "node2");
+      storage->set_property("node1.node2.property", 1);
+      storage->unmount(volume2, "");
+   }
+
+   auto storage = std::make_unique<Storage>();
+   auto volume = storage->open_volume("volume", false);
+   auto volume2 = storage->open_volume("volume2", false);
+   storage->mount(volume, "");
+   storage->mount(volume2, "");
+
+   // First volume doesn't have the path, so its nodes are not loaded
+   int value;
+   BOOST_CHECK(storage->get_property("node1.node2.property", value));
+   BOOST_CHECK(volume->get_node_cache_statistics().misses == 0);
+
+   storage->rename_node("node1.node3", "node2");
+   BOOST_CHECK(!storage->get_property("node1.node2.property", value));
+   storage->remove_node("node1.node2");
+   BOOST_CHECK(storage->get_property("node1.node2.property", value));
+   storage->add_node("node1", "node2");
+   BOOST_CHECK(!storage->get_property("node1.node2.property", value));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -1,3 +1,5 @@
+#include <fstream>
+
 #include "storage.h"
 #include "node.h"
 
@@ -37,4 +39,171 @@ BOOST_AUTO_TEST_CASE(load_volume)
    }
 }
 
+BOOST_AUTO_TEST_CASE(load_volume_with_moved_records)
+{
+   remove("volume");
+   {
+      auto storage = std::make_unique<Storage>();
+      auto volume = storage->open_volume("volume", true);
+      storage->mount(volume, "");
+      storage->add_node("", "node1");
+      storage->add_node("node1", "node2");
+      storage->add_node("node1.node2", "node3");
+
+      // Growing nodes moves their records to larger size classes
+      for (int i = 0; i < 100; i++) {
+         storage->set_property("node1.node2.property" + std::to_string(i), i);
+         storage->set_property("node1.property" + std::to_string(i), i);
+         storage->add_node("node1.node2.node3", "node" + std::to_string(i));
+      }
+      storage->unmount(volume, "");
+   }
+   {
+      auto storage = std::make_unique<Storage>();
+      auto volume = storage->open_volume("volume", false);
+      storage->mount(volume, "");
+
+      for (int i = 0; i < 100; i++) {
+         int value;
+         BOOST_CHECK(storage->get_property("node1.node2.property" + std::to_string(i), value));
+         BOOST_CHECK(value == i);
+         BOOST_CHECK(storage->get_property("node1.property" + std::to_string(i), value));
+         BOOST_CHECK(value == i);
+         BOOST_CHECK(storage->get_node("node1.node2.node3.node" + std::to_string(i)) != nullptr);
+      }
+   }
+}
+
+BOOST_AUTO_TEST_CASE(load_volume_written_back)
+{
+   remove("volume");
+
+   VolumeOptions options;
+   options.write_back = true;
+   options.flush_interval = std::chrono::milliseconds(10000);
+
+   std::vector<char> data(1000, 'a');
+   {
+      auto storage = std::make_unique<Storage>();
+      auto volume = storage->open_volume("volume", true, options);
+      storage->mount(volume, "");
+      storage->add_node("", "node1");
+      for (int i = 0; i < 1000; i++) {
+         storage->set_property("node1.counter", i);
+      }
+      storage->set_property("node1.blob", std::vector<char>(10, 'b'));
+      storage->set_property("node1.blob", data);
+
+      int value;
+      BOOST_CHECK(storage->get_property("node1.counter", value));
+      BOOST_CHECK(value == 999);
+      storage->unmount(volume, "");
+   }
+   {
+      auto storage = std::make_unique<Storage>();
+      auto volume = storage->open_volume("volume", false);
+      storage->mount(volume, "");
+
+      int value;
+      BOOST_CHECK(storage->get_property("node1.counter", value));
+      BOOST_CHECK(value == 999);
+
+      std::vector<char> blob;
+      BOOST_CHECK(storage->get_property("node1.blob", blob));
+      BOOST_CHECK(blob == data);
+   }
+}
+
+BOOST_AUTO_TEST_CASE(load_volume_with_large_blobs)
+{
+   remove("volume");
+
+   // Chunked, with a tail of several chunks
+   std::vector<char> data(2 * 1024 * 1024 + 1000);
+   for (size_t i = 0; i < data.size(); i++) {
+      data[i] = static_cast<char>(i % 251);
+   }
+   {
+      auto storage = std::make_unique<Storage>();
+      auto volume = storage->open_volume("volume", true);
+      storage->mount(volume, "");
+      storage->add_node("", "node1");
+      storage->set_property("node1.blob", data);
+      storage->set_property("node1.small_blob", std::vector<char>(10, 's'));
+      storage->unmount(volume, "");
+   }
+   {
+      // Not padded to a 4 MB record
+      std::ifstream file("volume", std::ios_base::binary | std::ios_base::ate);
+      BOOST_CHECK(static_cast<size_t>(file.tellg()) < 3 * 1024 * 1024);
+   }
+   {
+      auto storage = std::make_unique<Storage>();
+      auto volume = storage->open_volume("volume", false);
+      storage->mount(volume, "");
+
+      std::vector<char> blob;
+      BOOST_CHECK(storage->get_property("node1.blob", blob));
+      BOOST_CHECK(blob == data);
+      BOOST_CHECK(storage->get_property("node1.small_blob", blob));
+      BOOST_CHECK(blob == std::vector<char>(10, 's'));
+
+      std::vector<char> replaced_data(1024 * 1024 + 1, 'r');
+      storage->set_property("node1.blob", replaced_data);
+      BOOST_CHECK(storage->get_property("node1.blob", blob));
+      BOOST_CHECK(blob == replaced_data);
+   }
+}
+
+BOOST_AUTO_TEST_CASE(load_volume_with_node_cache)
+{
+   remove("volume");
+   {
+      auto storage = std::make_unique<Storage>();
+      auto volume = storage->open_volume("volume", true);
+      storage->mount(volume, "");
+      storage->add_node("", "node1");
+      storage->add_node("node1", "node2");
+      storage->set_property("node1.node2.property", 1);
+      storage->unmount(volume, "");
+   }
+
+   VolumeOptions options;
+   options.node_cache_size = 1024 * 1024;
+   {
+      auto storage = std::make_unique<Storage>();
+      auto volume = storage->open_volume("volume", false, options);
+      int value;
+      for (int i = 0; i < 3; i++) {
+         // Mounting again drops nodes resolved by storage, only the node cache keeps them loaded
+         storage->mount(volume, "");
+         BOOST_CHECK(storage->get_property("node1.node2.property", value));
+         storage->unmount(volume, "");
+      }
+
+      NodeCacheStatistics statistics = volume->get_node_cache_statistics();
+      BOOST_CHECK(statistics.misses == 2);
+      BOOST_CHECK(statistics.hits >= 4);
+      BOOST_CHECK(statistics.evictions == 0);
+      BOOST_CHECK(statistics.nodes_count == 2);
+   }
+
+   options.node_cache_size = 1;
+   {
+      auto storage = std::make_unique<Storage>();
+      auto volume = storage->open_volume("volume", false, options);
+      int value;
+      for (int i = 0; i < 3; i++) {
+         storage->mount(volume, "");
+         BOOST_CHECK(storage->get_property("node1.node2.property", value));
+         storage->unmount(volume, "");
+      }
+
+      NodeCacheStatistics statistics = volume->get_node_cache_statistics();
+      BOOST_CHECK(statistics.misses > 2);
+      BOOST_CHECK(statistics.evictions > 0);
+      BOOST_CHECK(statistics.nodes_count <= 1);
+   }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
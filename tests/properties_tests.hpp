@@ -1,5 +1,9 @@
+#include <cstring>
+
 #include "storage.h"
 #include "node.h"
+#include "property_handle.h"
+#include "errors.h"
 
 using namespace hks;
 
@@ -32,8 +36,8 @@ BOOST_AUTO_TEST_CASE(test_conversions_double)
 
    check_property_value(storage.get(), "node.property", 3);
    check_property_value(storage.get(), "node.property", 3U);
-   check_property_value(storage.get(), "node.property", 3LL);
-   check_property_value(storage.get(), "node.property", 3ULL);
+   check_property_value(storage.get(), "node.property", int64_t(3));
+   check_property_value(storage.get(), "node.property", uint64_t(3));
    check_property_value(storage.get(), "node.property", 3.5f);
    check_property_value(storage.get(), "node.property", 3.5);
    check_property_value(storage.get(), "node.property", 3.5l);
@@ -53,8 +57,8 @@ BOOST_AUTO_TEST_CASE(test_conversions_int)
 
    check_property_value(storage.get(), "node.property", 3);
    check_property_value(storage.get(), "node.property", 3U);
-   check_property_value(storage.get(), "node.property", 3LL);
-   check_property_value(storage.get(), "node.property", 3ULL);
+   check_property_value(storage.get(), "node.property", int64_t(3));
+   check_property_value(storage.get(), "node.property", uint64_t(3));
    check_property_value(storage.get(), "node.property", 3.0f);
    check_property_value(storage.get(), "node.property", 3.0);
    check_property_value(storage.get(), "node.property", 3.0l);
@@ -160,6 +164,76 @@ BOOST_AUTO_TEST_CASE(test_remove_property)
    check_property_inaccessible<std::vector<char>>(storage.get(), "node.property2");
 }
 
+BOOST_AUTO_TEST_CASE(test_property_handle)
+{
+   remove("volume");
+   auto storage = std::make_unique<Storage>();
+   auto volume = storage->open_volume("volume", true);
+   storage->mount(volume, "");
+
+   BOOST_CHECK_THROW(storage->prepare("property"), Exception);
+
+   auto handle = storage->prepare("node.property");
+   int value = 0;
+   BOOST_CHECK(!handle->get(value));
+   BOOST_CHECK(!handle->set(1));
+
+   storage->add_node("", "node");
+   BOOST_CHECK(handle->set(1));
+   BOOST_CHECK(handle->get(value));
+   BOOST_CHECK(value == 1);
+   check_property_value(storage.get(), "node.property", 1);
+
+   storage->set_property("node.other_property", 2);
+   BOOST_CHECK(storage->remove_property("node.other_property"));
+   BOOST_CHECK(handle->set(std::string("3")));
+   check_property_value(storage.get(), "node.property", std::string("3"));
+
+   BOOST_CHECK(handle->remove());
+   BOOST_CHECK(!handle->get(value));
+
+   // Handle follows the node the path refers to
+   storage->remove_node("node");
+   BOOST_CHECK(!handle->set(4));
+   storage->add_node("", "node");
+   BOOST_CHECK(handle->set(4));
+   storage->rename_node("node", "renamed");
+   BOOST_CHECK(!handle->get(value));
+   check_property_value(storage.get(), "renamed.property", 4);
+}
+
+BOOST_AUTO_TEST_CASE(test_multiple_properties)
+{
+   remove("volume");
+   auto storage = std::make_unique<Storage>();
+   auto volume = storage->open_volume("volume", true);
+   storage->mount(volume, "");
+
+   storage->add_node("", "node1");
+   storage->add_node("node1", "node2");
+
+   std::vector<std::pair<std::string, Value>> properties = {
+      { "node1.int", 1 },
+      { "node1.node2.string", std::string("string") },
+      { "node1.node2.blob", std::vector<char>(10, 'a') },
+      { "node3.int", 3 },
+      { "node1.double", 1.5 }
+   };
+   std::vector<bool> results = storage->set_properties(properties);
+   BOOST_CHECK(results == std::vector<bool>({ true, true, true, false, true }));
+
+   std::vector<std::optional<Value>> values = storage->get_properties({ "node1.node2.blob", "node1.int", "node1.missing", "node3.int", "node1.node2.string", "node1.double" });
+   BOOST_REQUIRE(values.size() == 6);
+   BOOST_CHECK(values[0] == Value(std::vector<char>(10, 'a')));
+   BOOST_CHECK(values[1] == Value(1));
+   BOOST_CHECK(!values[2]);
+   BOOST_CHECK(!values[3]);
+   BOOST_CHECK(values[4] == Value(std::string("string")));
+   BOOST_CHECK(values[5] == Value(1.5));
+
+   BOOST_CHECK_THROW(storage->get_properties({ "node1.int", "property" }), Exception);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 
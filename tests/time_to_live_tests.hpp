@@ -3,6 +3,7 @@
 
 #include "storage.h"
 #include "node.h"
+#include "property_handle.h"
 
 using namespace hks;
 
@@ -34,4 +35,458 @@ BOOST_AUTO_TEST_CASE(test_time_to_live)
    BOOST_CHECK(node3->is_deleted());
 }
 
+BOOST_AUTO_TEST_CASE(test_time_to_live_expired_reads)
+{
+   using namespace std::literals::chrono_literals;
+
+   remove("volume");
+   auto storage = std::make_unique<Storage>();
+   auto volume = storage->open_volume("volume", true);
+   storage->mount(volume, "");
+   auto node1 = storage->add_node("", "node1");
+   storage->add_node("", "node2")->set_time_to_live(1h);
+   BOOST_CHECK(storage->get_node("node1") != nullptr);
+
+   storage->add_node("node1", "child")->set_property("prop", 1);
+   int value;
+   BOOST_CHECK(storage->get_property("node1.child.prop", value));
+
+   // Absent right away, whether it's removed or not, with descendants of cached paths
+   node1->set_time_to_live(0ms);
+   BOOST_CHECK(storage->get_node("node1") == nullptr);
+   BOOST_CHECK(storage->get_node("")->get_child("node1") == nullptr);
+   BOOST_CHECK(storage->get_node("node1.child") == nullptr);
+   BOOST_CHECK(!storage->get_property("node1.child.prop", value));
+   BOOST_CHECK(storage->get_node("node2") != nullptr);
+
+   // Writes see it as absent too
+   auto node2 = storage->get_node("node2");
+   node2->add_child("child1");
+   node2->add_child("child2");
+   node2->get_child("child1")->set_time_to_live(0ms);
+   node2->get_child("child2")->set_time_to_live(0ms);
+   BOOST_CHECK_NO_THROW(storage->add_node("", "node1"));
+   BOOST_CHECK_THROW(node2->rename_child("child1", "child3"), NoSuchNode);
+   node2->add_child("child3");
+   BOOST_CHECK_NO_THROW(node2->rename_child("child3", "child2"));
+   BOOST_CHECK(storage->get_node("node2.child2") != nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(test_time_to_live_expired_handle)
+{
+   using namespace std::literals::chrono_literals;
+
+   remove("volume");
+   auto storage = std::make_unique<Storage>();
+   auto volume = storage->open_volume("volume", true);
+   storage->mount(volume, "");
+   auto node1 = storage->add_node("", "node1");
+   auto node2 = storage->add_node("node1", "node2");
+   node1->set_property("prop", 1);
+   node2->set_property("prop", 2);
+   auto handle1 = storage->prepare("node1.prop");
+   auto handle2 = storage->prepare("node1.node2.prop");
+   int value;
+   BOOST_CHECK(handle1->get(value) && value == 1);
+   BOOST_CHECK(handle2->get(value) && value == 2);
+
+   // Handles don't reach the expired node and its children, whether it's removed or not
+   node1->set_time_to_live(0ms);
+   BOOST_CHECK(!handle1->get(value));
+   BOOST_CHECK(!handle2->get(value));
+   BOOST_CHECK(!handle1->set(3));
+   BOOST_CHECK(!handle2->set(3));
+}
+
+BOOST_AUTO_TEST_CASE(test_time_to_live_many_nodes)
+{
+   using namespace std::literals::chrono_literals;
+   const int NODES_COUNT = 1000;
+
+   auto get_parent_path = [](int i) { return i % 2 == 0 ? std::string("parent1") : std::string("parent2"); };
+   auto get_node_path = [&](int i) { return get_parent_path(i) + ".node" + std::to_string(i); };
+
+   auto wait_for_removal = [](Storage* storage, const std::string& path) {
+      for (int i = 0; i < 500 && storage->get_node(path) != nullptr; i++) {
+         std::this_thread::sleep_for(10ms);
+      }
+   };
+
+   remove("volume");
+   {
+      auto storage = std::make_unique<Storage>();
+      auto volume = storage->open_volume("volume", true);
+      storage->mount(volume, "");
+      storage->add_node("", "parent1");
+      storage->add_node("", "parent2");
+
+      // Expiring nodes are spread over the time to live tree, which has many leaves
+      for (int i = 0; i < NODES_COUNT; i++) {
+         auto node = storage->add_node(get_parent_path(i), "node" + std::to_string(i));
+         node->set_time_to_live(i % 3 == 0 ? 100ms : 1h);
+      }
+
+      wait_for_removal(storage.get(), get_node_path(NODES_COUNT - 1));
+      std::this_thread::sleep_for(100ms);
+      for (int i = 0; i < NODES_COUNT; i++) {
+         BOOST_CHECK((storage->get_node(get_node_path(i)) == nullptr) == (i % 3 == 0));
+      }
+      storage->unmount(volume, "");
+   }
+   {
+      auto storage = std::make_unique<Storage>();
+      auto volume = storage->open_volume("volume", false);
+      storage->mount(volume, "");
+
+      for (int i = 0; i < NODES_COUNT; i++) {
+         if (i % 3 != 0) {
+            storage->get_node(get_node_path(i))->set_time_to_live(50ms);
+         }
+      }
+
+      wait_for_removal(storage.get(), get_node_path(NODES_COUNT - 2));
+      std::this_thread::sleep_for(100ms);
+      for (int i = 0; i < NODES_COUNT; i++) {
+         BOOST_CHECK(storage->get_node(get_node_path(i)) == nullptr);
+      }
+   }
+}
+
+BOOST_AUTO_TEST_CASE(test_time_to_live_refresh)
+{
+   using namespace std::literals::chrono_literals;
+
+   remove("volume");
+   {
+      auto storage = std::make_unique<Storage>();
+      auto volume = storage->open_volume("volume", true);
+      storage->mount(volume, "");
+      auto node = storage->add_node("", "node");
+
+      // Refreshed node stays
+      for (int i = 0; i < 20; i++) {
+         node->set_time_to_live(100ms);
+         std::this_thread::sleep_for(20ms);
+      }
+      BOOST_CHECK(storage->get_node("node") != nullptr);
+
+      // The last time is written to the time to live tree when the volume is closed
+      node->set_time_to_live(200ms);
+      storage->unmount(volume, "");
+   }
+   {
+      auto storage = std::make_unique<Storage>();
+      auto volume = storage->open_volume("volume", false);
+      storage->mount(volume, "");
+      for (int i = 0; i < 100 && storage->get_node("node") != nullptr; i++) {
+         std::this_thread::sleep_for(10ms);
+      }
+      BOOST_CHECK(storage->get_node("node") == nullptr);
+   }
+}
+
+BOOST_AUTO_TEST_CASE(test_time_to_live_many_volumes)
+{
+   using namespace std::literals::chrono_literals;
+   const int VOLUMES_COUNT = 20;
+
+   set_time_to_live_threads_count(3);
+   {
+      auto storage = std::make_unique<Storage>();
+      remove("volume");
+      storage->mount(storage->open_volume("volume", true), "");
+      for (int i = 0; i < VOLUMES_COUNT; i++) {
+         std::string name = "volume" + std::to_string(i);
+         remove(name.c_str());
+         storage->add_node("", name);
+         storage->mount(storage->open_volume(name, true), name);
+         storage->add_node(name, "node1")->set_time_to_live(50ms + 10ms * i);
+         storage->add_node(name, "node2")->set_time_to_live(1h);
+      }
+
+      std::string last_path = "volume" + std::to_string(VOLUMES_COUNT - 1) + ".node1";
+      for (int i = 0; i < 200 && storage->get_node(last_path) != nullptr; i++) {
+         std::this_thread::sleep_for(10ms);
+      }
+      for (int i = 0; i < VOLUMES_COUNT; i++) {
+         std::string name = "volume" + std::to_string(i);
+         BOOST_CHECK(storage->get_node(name + ".node1") == nullptr);
+         BOOST_CHECK(storage->get_node(name + ".node2") != nullptr);
+      }
+   }
+   set_time_to_live_threads_count(2);
+}
+
+BOOST_AUTO_TEST_CASE(test_time_to_live_large_subtree)
+{
+   using namespace std::literals::chrono_literals;
+   const int CHILDREN_COUNT = 30;
+
+   // Not loaded nodes of the subtree are loaded by the removal
+   VolumeOptions options;
+   options.node_cache_size = 0;
+
+   remove("volume");
+   auto storage = std::make_unique<Storage>();
+   auto volume = storage->open_volume("volume", true, options);
+   storage->mount(volume, "");
+
+   storage->add_node("", "tree");
+   std::shared_ptr<Node> grandchild;
+   for (int i = 0; i < CHILDREN_COUNT; i++) {
+      std::string child_name = "child" + std::to_string(i);
+      storage->add_node("tree", child_name);
+      for (int j = 0; j < CHILDREN_COUNT; j++) {
+         grandchild = storage->add_node("tree." + child_name, "grandchild" + std::to_string(j));
+      }
+   }
+   storage->get_node("tree")->set_time_to_live(50ms);
+   auto node = storage->add_node("", "node");
+   node->set_time_to_live(60ms);
+
+   for (int i = 0; i < 200 && !(grandchild->is_deleted() && node->is_deleted()); i++) {
+      std::this_thread::sleep_for(10ms);
+   }
+   BOOST_CHECK(storage->get_node("tree") == nullptr);
+   BOOST_CHECK(grandchild->is_deleted());
+   BOOST_CHECK(node->is_deleted());
+}
+
+BOOST_AUTO_TEST_CASE(test_time_to_live_deep_nodes)
+{
+   using namespace std::literals::chrono_literals;
+
+   remove("volume");
+   {
+      auto storage = std::make_unique<Storage>();
+      auto volume = storage->open_volume("volume", true);
+      storage->mount(volume, "");
+      storage->add_node("", "a");
+      storage->add_node("a", "b");
+      storage->add_node("a.b", "c")->set_time_to_live(200ms);
+      storage->add_node("a.b.c", "d");
+      storage->add_node("a.b", "e")->set_property("prop", 1);
+      storage->get_node("a.b.e")->set_property_time_to_live("prop", 200ms);
+      storage->unmount(volume, "");
+   }
+   {
+      // Nodes are found by their ids, none of them is loaded
+      auto storage = std::make_unique<Storage>();
+      auto volume = storage->open_volume("volume", false);
+      storage->mount(volume, "");
+      std::this_thread::sleep_for(300ms);
+      BOOST_CHECK(storage->get_node("a.b.c") == nullptr);
+      BOOST_CHECK_NO_THROW(storage->add_node("a.b", "c"));
+
+      int value;
+      std::shared_ptr<Node> node = storage->get_node("a.b.e");
+      for (int i = 0; i < 50 && node->get_property("prop", value); i++) {
+         std::this_thread::sleep_for(10ms);
+      }
+      BOOST_CHECK(!node->get_property("prop", value));
+      BOOST_CHECK(storage->get_node("a.b") != nullptr);
+   }
+}
+
+BOOST_AUTO_TEST_CASE(test_children_time_to_live)
+{
+   using namespace std::literals::chrono_literals;
+
+   remove("volume");
+   const int NODES_COUNT = 1000;
+   {
+      auto storage = std::make_unique<Storage>();
+      auto volume = storage->open_volume("volume", true);
+      storage->mount(volume, "");
+      auto node1 = storage->add_node("", "node1");
+      auto node2 = storage->add_node("", "node2");
+      std::vector<std::pair<std::string, std::chrono::milliseconds>> times;
+      for (int i = 0; i < NODES_COUNT; i++) {
+         node1->add_child(std::to_string(i));
+         node2->add_child(std::to_string(i));
+         times.push_back({ std::to_string(i), i % 2 == 0 ? 200ms : 1h });
+      }
+
+      node1->set_children_time_to_live(200ms);
+      node2->set_children_time_to_live(times);
+      times.push_back({ "missing", 1h });
+      BOOST_CHECK_THROW(node2->set_children_time_to_live(times), NoSuchNode);
+      storage->unmount(volume, "");
+   }
+   {
+      // Times are written to the tree when the volume is closed
+      auto storage = std::make_unique<Storage>();
+      auto volume = storage->open_volume("volume", false);
+      storage->mount(volume, "");
+      std::this_thread::sleep_for(300ms);
+      for (int i = 0; i < NODES_COUNT; i++) {
+         BOOST_CHECK(storage->get_node("node1." + std::to_string(i)) == nullptr);
+         BOOST_CHECK((storage->get_node("node2." + std::to_string(i)) == nullptr) == (i % 2 == 0));
+      }
+
+      // Names of expired children can be taken again
+      std::shared_ptr<Node> node1 = storage->get_node("node1");
+      BOOST_CHECK_NO_THROW(node1->add_child("0"));
+      BOOST_CHECK_NO_THROW(node1->add_child(std::to_string(NODES_COUNT - 1)));
+   }
+}
+
+BOOST_AUTO_TEST_CASE(test_sliding_time_to_live_handle)
+{
+   using namespace std::literals::chrono_literals;
+
+   remove("volume");
+   auto storage = std::make_unique<Storage>();
+   auto volume = storage->open_volume("volume", true);
+   storage->mount(volume, "");
+   auto node1 = storage->add_node("", "node1");
+   node1->set_property("prop", 1);
+   node1->set_sliding_time_to_live(100ms);
+   auto handle = storage->prepare("node1.prop");
+
+   // Accesses through the handle keep the node
+   int value;
+   for (int i = 0; i < 10; i++) {
+      std::this_thread::sleep_for(30ms);
+      BOOST_CHECK(handle->get(value));
+   }
+   BOOST_CHECK(!node1->is_deleted());
+
+   for (int i = 0; i < 50 && !node1->is_deleted(); i++) {
+      std::this_thread::sleep_for(10ms);
+   }
+   BOOST_CHECK(node1->is_deleted());
+}
+
+BOOST_AUTO_TEST_CASE(test_sliding_time_to_live)
+{
+   using namespace std::literals::chrono_literals;
+
+   remove("volume");
+   {
+      auto storage = std::make_unique<Storage>();
+      auto volume = storage->open_volume("volume", true);
+      storage->mount(volume, "");
+      storage->add_node("", "node1")->set_sliding_time_to_live(100ms);
+
+      // Found by a path or touched
+      for (int i = 0; i < 10; i++) {
+         std::this_thread::sleep_for(30ms);
+         if (i % 2 == 0) {
+            BOOST_CHECK(storage->get_node("node1") != nullptr);
+         } else {
+            storage->get_node("")->get_child("node1")->touch();
+         }
+      }
+      BOOST_CHECK(storage->get_node("node1") != nullptr);
+
+      std::shared_ptr<Node> node1 = storage->get_node("node1");
+      for (int i = 0; i < 50 && !node1->is_deleted(); i++) {
+         std::this_thread::sleep_for(10ms);
+      }
+      BOOST_CHECK(node1->is_deleted());
+
+      // The last access is saved when the volume is closed
+      storage->add_node("", "node2")->set_sliding_time_to_live(500ms);
+      std::this_thread::sleep_for(300ms);
+      BOOST_CHECK(storage->get_node("node2") != nullptr);
+      storage->unmount(volume, "");
+   }
+   {
+      auto storage = std::make_unique<Storage>();
+      auto volume = storage->open_volume("volume", false);
+      storage->mount(volume, "");
+      std::this_thread::sleep_for(300ms);
+      std::shared_ptr<Node> node2 = storage->get_node("node2");
+      BOOST_CHECK(node2 != nullptr);
+
+      for (int i = 0; i < 100 && !node2->is_deleted(); i++) {
+         std::this_thread::sleep_for(10ms);
+      }
+      BOOST_CHECK(node2->is_deleted());
+   }
+}
+
+BOOST_AUTO_TEST_CASE(test_property_time_to_live)
+{
+   using namespace std::literals::chrono_literals;
+
+   remove("volume");
+   {
+      auto storage = std::make_unique<Storage>();
+      auto volume = storage->open_volume("volume", true);
+      storage->mount(volume, "");
+      auto node = storage->add_node("", "node");
+      node->set_property("prop1", 1);
+      node->set_property("prop2", 2);
+      node->set_property("prop3", 3);
+      BOOST_CHECK(!node->set_property_time_to_live("prop4", 100ms));
+
+      BOOST_CHECK(node->set_property_time_to_live("prop1", 100ms));
+      BOOST_CHECK(node->set_property_time_to_live("prop3", 500ms));
+      int value;
+      for (int i = 0; i < 50 && node->get_property("prop1", value); i++) {
+         std::this_thread::sleep_for(10ms);
+      }
+      BOOST_CHECK(!node->get_property("prop1", value));
+      BOOST_CHECK(node->get_property("prop2", value));
+      BOOST_CHECK(node->get_property("prop3", value));
+      storage->unmount(volume, "");
+   }
+   {
+      // The time is kept in the volume
+      auto storage = std::make_unique<Storage>();
+      auto volume = storage->open_volume("volume", false);
+      storage->mount(volume, "");
+      auto node = storage->get_node("node");
+      int value;
+      for (int i = 0; i < 100 && node->get_property("prop3", value); i++) {
+         std::this_thread::sleep_for(10ms);
+      }
+      BOOST_CHECK(!node->get_property("prop3", value));
+      BOOST_CHECK(node->get_property("prop2", value) && value == 2);
+      BOOST_CHECK(!node->is_deleted());
+   }
+}
+
+BOOST_AUTO_TEST_CASE(test_property_time_to_live_expired_reads)
+{
+   using namespace std::literals::chrono_literals;
+
+   remove("volume");
+   auto storage = std::make_unique<Storage>();
+   auto volume = storage->open_volume("volume", true);
+   storage->mount(volume, "");
+   auto node = storage->add_node("", "node");
+   node->set_property("prop1", 1);
+   node->set_property("prop2", 2);
+   auto handle = storage->prepare("node.prop1");
+
+   // Absent right away for all reads, whether it's removed or not
+   int value;
+   BOOST_CHECK(handle->get(value));
+   BOOST_CHECK(node->set_property_time_to_live("prop1", 0ms));
+   BOOST_CHECK(!node->get_property("prop1", value));
+   BOOST_CHECK(!storage->get_property("node.prop1", value));
+   BOOST_CHECK(!handle->get(value));
+   std::vector<std::optional<Value>> values = storage->get_properties({ "node.prop1", "node.prop2" });
+   BOOST_CHECK(!values[0]);
+   BOOST_CHECK(values[1]);
+   BOOST_CHECK(!node->set_property_time_to_live("prop1", 1h));
+
+   // Setting it again creates it without the time
+   node->set_property("prop1", 3);
+   std::this_thread::sleep_for(100ms);
+   BOOST_CHECK(node->get_property("prop1", value) && value == 3);
+
+   // Property which hasn't expired keeps its time
+   BOOST_CHECK(node->set_property_time_to_live("prop2", 100ms));
+   node->set_property("prop2", 4);
+   for (int i = 0; i < 50 && node->get_property("prop2", value); i++) {
+      std::this_thread::sleep_for(10ms);
+   }
+   BOOST_CHECK(!node->get_property("prop2", value));
+   BOOST_CHECK(!node->remove_property("prop2"));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,105 @@
+#include <mutex>
+#include <algorithm>
+
+#include "storage.h"
+#include "node.h"
+#include "tracing.h"
+
+using namespace hks;
+
+BOOST_AUTO_TEST_SUITE(tracing_tests)
+
+class RecordingTracer : public Tracer
+{
+public:
+   void begin(const TraceData& data) override
+   {
+      std::lock_guard<std::mutex> locker(lock);
+      begins.push_back(data.event);
+   }
+
+   void end(const TraceData& data) override
+   {
+      std::lock_guard<std::mutex> locker(lock);
+      ends.push_back(data);
+      if (data.event == TraceEvent::resolve_path) {
+         resolved_paths.emplace_back(data.path);
+      }
+   }
+
+   size_t count_ends(TraceEvent event)
+   {
+      std::lock_guard<std::mutex> locker(lock);
+      return std::count_if(ends.begin(), ends.end(), [&](const TraceData& data) { return data.event == event; });
+   }
+
+   std::mutex lock;
+   std::vector<TraceEvent> begins;
+   std::vector<TraceData> ends;
+   std::vector<std::string> resolved_paths;
+};
+
+BOOST_AUTO_TEST_CASE(test_tracer_events)
+{
+   remove("volume");
+   auto storage = std::make_unique<Storage>();
+   // Mounting again drops nodes resolved by storage, so with the small node cache they are loaded again
+   VolumeOptions options;
+   options.node_cache_size = 1;
+   auto volume = storage->open_volume("volume", true, options);
+   storage->mount(volume, "");
+   storage->add_node("", "node1");
+   storage->set_property("node1.property", 1);
+   storage->unmount(volume, "");
+   storage->mount(volume, "");
+
+   RecordingTracer tracer;
+   set_tracer(&tracer);
+   int value;
+   BOOST_CHECK(storage->get_property("node1.property", value));
+   storage->set_property("node1.property", std::string(1000, 'a'));
+   volume->flush();
+   set_tracer(nullptr);
+
+   BOOST_CHECK(tracer.begins.size() == tracer.ends.size());
+   BOOST_CHECK(tracer.resolved_paths == std::vector<std::string>({ "node1", "node1" }));
+   BOOST_CHECK(tracer.count_ends(TraceEvent::node_load) >= 1);
+   BOOST_CHECK(tracer.count_ends(TraceEvent::record_read) >= 1);
+   BOOST_CHECK(tracer.count_ends(TraceEvent::node_save) >= 1);
+   BOOST_CHECK(tracer.count_ends(TraceEvent::record_relocation) == 1);
+   BOOST_CHECK(tracer.count_ends(TraceEvent::node_record_update) == 1);
+
+   for (const TraceData& data : tracer.ends) {
+      if (data.event == TraceEvent::resolve_path) {
+         BOOST_CHECK(data.node_id != 0);
+      } else if (data.event == TraceEvent::node_load) {
+         BOOST_CHECK(data.size > 0);
+      } else if (data.event == TraceEvent::record_relocation) {
+         BOOST_CHECK(data.size > 1000);
+         BOOST_CHECK(data.record_id != 0);
+      }
+   }
+}
+
+BOOST_AUTO_TEST_CASE(test_tracer_reset)
+{
+   remove("volume");
+   auto storage = std::make_unique<Storage>();
+   auto volume = storage->open_volume("volume", true);
+   storage->mount(volume, "");
+
+   RecordingTracer tracer;
+   set_tracer(&tracer);
+   storage->add_node("", "node1");
+   set_tracer(nullptr);
+   size_t events_count = tracer.ends.size();
+   BOOST_CHECK(events_count > 0);
+
+   // No events after the tracer is reset
+   storage->add_node("node1", "node2");
+   storage->set_property("node1.node2.property", 1);
+   volume->flush();
+   BOOST_CHECK(tracer.ends.size() == events_count);
+}
+
+BOOST_AUTO_TEST_SUITE_END()